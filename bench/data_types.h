@@ -0,0 +1,50 @@
+#pragma once
+// The types of data/test.cpp, plus a batch holding many of them the way a message would.
+
+#include <string>
+#include <vector>
+
+namespace name {
+struct MyStruct {
+    int x;
+    float y;
+    void method_sss() {}
+};
+
+struct Base {
+    float a;
+    int b;
+};
+
+enum class Color : int { red, green, blue };
+} // namespace name
+
+struct whatever {};
+
+template<typename T, typename T1, int v = 0>
+struct MyTemplateStruct {
+    T data;
+    T1 data1;
+    T get() {
+        return data;
+    }
+    void nop() {}
+    T1 gen() {
+        T1 a;
+        return a;
+    }
+    void params(const float p1, const name::Base& p2, const T1& p3) {}
+
+    void operator+(){};
+};
+
+namespace bench {
+struct Batch {
+    std::string label;
+    std::vector<name::MyStruct> structs;
+    std::vector<name::Base> bases;
+    std::vector<MyTemplateStruct<name::Base, whatever>> templated;
+    name::Color color;
+    long long sequence;
+};
+} // namespace bench
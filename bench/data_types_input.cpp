@@ -0,0 +1,13 @@
+// Generator input for the benchmarks that run generated code on the data/test.cpp types.
+#include "data_types.h"
+
+template<typename T, typename Enable = void>
+struct reflect {
+    static constexpr auto size = sizeof(T);
+};
+
+static_assert(sizeof(reflect<name::MyStruct>) > 0);
+static_assert(sizeof(reflect<name::Base>) > 0);
+static_assert(sizeof(reflect<MyTemplateStruct<name::Base, whatever>>) > 0);
+static_assert(sizeof(reflect<name::Color>) > 0);
+static_assert(sizeof(reflect<bench::Batch>) > 0);
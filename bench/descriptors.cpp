@@ -0,0 +1,117 @@
+// Compares the frontend time of consumers of the std::tuple based reflection against the --descriptors mode.
+//
+// usage: refl_bench_descriptors <refl> <c++ compiler> [fields per struct = 400] [structs = 4] [repetitions = 5]
+//
+// A set of wide structs in the shape of data/test.cpp is written to the working directory, the generator is run on it
+// in both modes, and a consumer that visits every field through the generated reflection is compiled with
+// -fsyntax-only against each header. The best of several runs is reported.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <string>
+
+static void WriteTypes(const std::string& path, int fields, int structs) {
+    std::ofstream os(path);
+    os << "#pragma once\n"
+          "namespace bench {\n";
+    for (int s = 0; s < structs; s++) {
+        os << "struct Wide" << s << " {\n";
+        for (int f = 0; f < fields; f++) {
+            os << "    " << (f % 2 ? "float" : "int") << " field" << f << ";\n";
+        }
+        os << "    void method() {}\n"
+              "};\n";
+    }
+    os << "} // namespace bench\n";
+}
+
+static void WriteInput(const std::string& path, int structs) {
+    std::ofstream os(path);
+    os << "#include \"wide_types.h\"\n"
+          "template<typename T, typename Enable = void>\n"
+          "struct reflect {\n"
+          "    static constexpr auto size = sizeof(T);\n"
+          "};\n";
+    for (int s = 0; s < structs; s++) {
+        os << "static_assert(sizeof(reflect<bench::Wide" << s << ">) > 0);\n";
+    }
+}
+
+static void WriteConsumer(const std::string& path, const std::string& header, int structs, bool descriptors) {
+    std::ofstream os(path);
+    os << "#include \"" << header << "\"\n"
+          "#include \"wide_types.h\"\n";
+    if (!descriptors) {
+        os << "#include <tuple>\n";
+    }
+    os << "double sum_all(";
+    for (int s = 0; s < structs; s++) {
+        os << (s ? ", " : "") << "const bench::Wide" << s << "& v" << s;
+    }
+    os << ") {\n"
+          "    double sum = 0;\n";
+    for (int s = 0; s < structs; s++) {
+        if (descriptors) {
+            os << "    reflect<bench::Wide" << s << ">::for_each_field([&](auto field) { sum += v" << s
+               << ".*(field.ptr); });\n";
+        } else {
+            os << "    std::apply([&](auto... field) { ((sum += v" << s << ".*(field.ptr)), ...); }, "
+               << "reflect<bench::Wide" << s << ">::fields());\n";
+        }
+    }
+    os << "    return sum;\n"
+          "}\n";
+}
+
+static int Run(const std::string& command) {
+    return std::system(command.c_str());
+}
+
+static double BestCompileSeconds(const std::string& command, int repetitions) {
+    double best = 1e30;
+    for (int i = 0; i < repetitions; i++) {
+        auto start = std::chrono::steady_clock::now();
+        if (Run(command) != 0) {
+            std::fprintf(stderr, "failed: %s\n", command.c_str());
+            std::exit(1);
+        }
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        best = std::min(best, elapsed.count());
+    }
+    return best;
+}
+
+int main(int argc, char** argv) {
+    if (argc < 3) {
+        std::fprintf(stderr, "usage: %s <refl> <c++ compiler> [fields] [structs] [repetitions]\n", argv[0]);
+        return 1;
+    }
+    std::string refl = argv[1];
+    std::string cxx = argv[2];
+    int fields = argc > 3 ? std::atoi(argv[3]) : 400;
+    int structs = argc > 4 ? std::atoi(argv[4]) : 4;
+    int repetitions = argc > 5 ? std::atoi(argv[5]) : 5;
+
+    WriteTypes("wide_types.h", fields, structs);
+    WriteInput("wide_input.cpp", structs);
+    WriteConsumer("consumer_tuple.cpp", "reflect_tuple.h", structs, false);
+    WriteConsumer("consumer_descriptors.cpp", "reflect_descriptors.h", structs, true);
+
+    if (Run(refl + " wide_input.cpp -o reflect_tuple.h -- -std=c++17") != 0 ||
+        Run(refl + " --descriptors wide_input.cpp -o reflect_descriptors.h -- -std=c++17") != 0) {
+        std::fprintf(stderr, "generator failed\n");
+        return 1;
+    }
+
+    auto compile = cxx + " -std=c++17 -fsyntax-only ";
+    auto tuple_seconds = BestCompileSeconds(compile + "consumer_tuple.cpp", repetitions);
+    auto descriptor_seconds = BestCompileSeconds(compile + "consumer_descriptors.cpp", repetitions);
+    std::printf("%d structs x %d fields, best of %d\n", structs, fields, repetitions);
+    std::printf("  tuple fields():        %8.3f s\n", tuple_seconds);
+    std::printf("  descriptors:           %8.3f s\n", descriptor_seconds);
+    std::printf("  speedup:               %8.2fx\n", tuple_seconds / descriptor_seconds);
+    return 0;
+}
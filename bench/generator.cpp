@@ -0,0 +1,210 @@
+// Measures the generator itself on a synthetic codebase: wall time and peak RSS of refl, the size of the header it
+// writes, and the time to compile a downstream translation unit that includes that header.
+//
+// usage: refl_bench_generator <refl> <c++ compiler> [namespaces = 8] [structs per namespace = 64]
+//                             [fields and methods per struct = 16] [template nesting depth = 3] [repetitions = 3]
+//                             [generator flags...]
+//
+// Every namespace gets its own input translation unit, so flags like -j apply. Structs carry fields of builtin types,
+// fields of the previous struct and methods with parameters, and each namespace instantiates a template in the shape
+// of data/test.cpp's MyTemplateStruct nested to the given depth, every level of which is reflected. Remaining
+// arguments are passed to the generator; the consumer visits fields with for_each_field() when --descriptors is
+// among them and through fields() otherwise. The best wall and compile times and the largest RSS are reported.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <string>
+
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+struct Shape {
+    int namespaces;
+    int structs;
+    int members;
+    int depth;
+};
+
+static const char* const field_types[] = {"int", "float", "double", "long", "bool", "unsigned char"};
+
+// Nested<Nested<S0, S1>, S2> for depth 2, reusing the namespace's first structs as arguments.
+static std::string NestedName(int depth) {
+    std::string name = "S0";
+    for (int level = 1; level <= depth; level++) {
+        name = "Nested<" + name + ", S" + std::to_string(level) + ">";
+    }
+    return name;
+}
+
+static void WriteTypes(const std::string& path, const Shape& shape) {
+    std::ofstream os(path);
+    os << "#pragma once\n"
+          "namespace synthetic {\n"
+          "template<typename T, typename T1, int v = 0>\n"
+          "struct Nested {\n"
+          "    T data;\n"
+          "    T1 data1;\n"
+          "    T get() { return data; }\n"
+          "    T1 gen() { return data1; }\n"
+          "    void params(const float p1, const T& p2, const T1& p3) {}\n"
+          "};\n"
+          "} // namespace synthetic\n";
+    for (int n = 0; n < shape.namespaces; n++) {
+        os << "namespace synthetic::ns" << n << " {\n"
+              "using synthetic::Nested;\n";
+        for (int s = 0; s < shape.structs; s++) {
+            os << "struct S" << s << " {\n";
+            for (int f = 0; f < shape.members; f++) {
+                if (s > 0 && f % 4 == 3) {
+                    os << "    S" << s - 1 << " field" << f << ";\n";
+                } else {
+                    os << "    " << field_types[f % std::size(field_types)] << " field" << f << ";\n";
+                }
+            }
+            for (int m = 0; m < shape.members; m++) {
+                os << "    int method" << m << "(int a, const float& b) const { return a + field0 + int(b); }\n";
+            }
+            os << "};\n";
+        }
+        os << "} // namespace synthetic::ns" << n << '\n';
+    }
+}
+
+static void WriteInput(const std::string& path, int n, const Shape& shape) {
+    std::ofstream os(path);
+    os << "#include \"synthetic_types.h\"\n"
+          "template<typename T, typename Enable = void>\n"
+          "struct reflect {\n"
+          "    static constexpr auto size = sizeof(T);\n"
+          "};\n"
+          "namespace synthetic::ns"
+       << n << " {\n";
+    for (int s = 0; s < shape.structs; s++) {
+        os << "static_assert(sizeof(reflect<S" << s << ">) > 0);\n";
+    }
+    for (int level = 1; level <= shape.depth; level++) {
+        os << "static_assert(sizeof(reflect<" << NestedName(level) << ">) > 0);\n";
+    }
+    os << "} // namespace synthetic::ns" << n << '\n';
+}
+
+static void WriteConsumer(const std::string& path, const Shape& shape, bool descriptors) {
+    std::ofstream os(path);
+    os << "#include \"synthetic_reflect.h\"\n"
+          "#include \"synthetic_types.h\"\n"
+          "#include <cstddef>\n"
+          "#include <tuple>\n"
+          "#include <utility>\n"
+          "template<typename T>\n"
+          "std::size_t field_bytes() {\n"
+          "    std::size_t bytes = 0;\n";
+    if (descriptors) {
+        os << "    reflect<T>::for_each_field([&](auto field) { bytes += sizeof(std::declval<T&>().*(field.ptr)); "
+              "});\n";
+    } else {
+        os << "    std::apply([&](auto... field) { ((bytes += sizeof(std::declval<T&>().*(field.ptr))), ...); }, "
+              "reflect<T>::fields());\n";
+    }
+    os << "    return bytes;\n"
+          "}\n";
+    for (int n = 0; n < shape.namespaces; n++) {
+        os << "namespace synthetic::ns" << n << " {\n"
+              "std::size_t total_field_bytes() {\n"
+              "    std::size_t bytes = 0;\n";
+        for (int s = 0; s < shape.structs; s++) {
+            os << "    bytes += ::field_bytes<S" << s << ">();\n";
+        }
+        for (int level = 1; level <= shape.depth; level++) {
+            os << "    bytes += ::field_bytes<" << NestedName(level) << ">();\n";
+        }
+        os << "    return bytes;\n"
+              "}\n"
+              "} // namespace synthetic::ns"
+           << n << '\n';
+    }
+}
+
+struct RunResult {
+    double seconds;
+    long peak_rss_kb;
+};
+
+// Runs |command| through the shell, reporting its wall time and the peak resident set size of the process tree.
+static RunResult Run(const std::string& command) {
+    auto start = std::chrono::steady_clock::now();
+    pid_t pid = fork();
+    if (pid == 0) {
+        execl("/bin/sh", "sh", "-c", command.c_str(), static_cast<char*>(nullptr));
+        _exit(127);
+    }
+    int status = 0;
+    struct rusage usage {};
+    if (pid < 0 || wait4(pid, &status, 0, &usage) != pid || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        std::fprintf(stderr, "failed: %s\n", command.c_str());
+        std::exit(1);
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    return {elapsed.count(), usage.ru_maxrss};
+}
+
+static RunResult Best(const std::string& command, int repetitions) {
+    RunResult best{1e30, 0};
+    for (int i = 0; i < repetitions; i++) {
+        auto result = Run(command);
+        best.seconds = std::min(best.seconds, result.seconds);
+        best.peak_rss_kb = std::max(best.peak_rss_kb, result.peak_rss_kb);
+    }
+    return best;
+}
+
+int main(int argc, char** argv) {
+    if (argc < 3) {
+        std::fprintf(stderr,
+                     "usage: %s <refl> <c++ compiler> [namespaces] [structs] [members] [depth] [repetitions] "
+                     "[generator flags...]\n",
+                     argv[0]);
+        return 1;
+    }
+    std::string refl = argv[1];
+    std::string cxx = argv[2];
+    Shape shape;
+    shape.namespaces = argc > 3 ? std::atoi(argv[3]) : 8;
+    shape.structs = argc > 4 ? std::atoi(argv[4]) : 64;
+    shape.members = std::max(argc > 5 ? std::atoi(argv[5]) : 16, 1);
+    shape.depth = std::min(argc > 6 ? std::atoi(argv[6]) : 3, shape.structs - 1);
+    int repetitions = argc > 7 ? std::atoi(argv[7]) : 3;
+    std::string flags;
+    bool descriptors = false;
+    for (int i = 8; i < argc; i++) {
+        flags += std::string(argv[i]) + ' ';
+        descriptors = descriptors || std::string(argv[i]) == "--descriptors";
+    }
+
+    WriteTypes("synthetic_types.h", shape);
+    std::string sources;
+    for (int n = 0; n < shape.namespaces; n++) {
+        std::string source = "synthetic_input" + std::to_string(n) + ".cpp";
+        WriteInput(source, n, shape);
+        sources += source + ' ';
+    }
+    WriteConsumer("synthetic_consumer.cpp", shape, descriptors);
+
+    auto generate = Best(refl + ' ' + flags + sources + "-o synthetic_reflect.h -- -std=c++17", repetitions);
+    auto output_bytes = std::filesystem::file_size("synthetic_reflect.h");
+    auto compile = Best(cxx + " -std=c++17 -c synthetic_consumer.cpp -o synthetic_consumer.o", repetitions);
+
+    int types = shape.namespaces * (shape.structs + shape.depth);
+    std::printf("%d namespaces x %d structs x %d fields/methods, template depth %d (%d reflected types), best of %d\n",
+                shape.namespaces, shape.structs, shape.members, shape.depth, types, repetitions);
+    std::printf("  generator wall time:   %8.3f s\n", generate.seconds);
+    std::printf("  generator peak RSS:    %8.1f MiB\n", generate.peak_rss_kb / 1024.0);
+    std::printf("  generated header:      %8.1f KiB\n", output_bytes / 1024.0);
+    std::printf("  consumer compile time: %8.3f s\n", compile.seconds);
+    return 0;
+}
@@ -0,0 +1,108 @@
+// Compares calling methods of the data/test.cpp types directly, through the generated invoker thunks and through
+// std::function.
+//
+// usage: refl_bench_invoker [calls = 100000000]
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <string_view>
+
+#include "data_types.h"
+
+#include "invoker_reflect.h"
+
+using Templated = MyTemplateStruct<name::Base, whatever>;
+using Reflection = reflect<Templated>;
+
+template<typename F>
+static double Seconds(F&& f) {
+    auto start = std::chrono::steady_clock::now();
+    f();
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    return elapsed.count();
+}
+
+static void Report(const char* label, double seconds, long calls) {
+    std::printf("  %-38s %8.3f ns/call\n", label, seconds * 1e9 / calls);
+}
+
+static std::size_t FindInvoker(const char* name) {
+    for (std::size_t i = 0; i < Reflection::invokers.size(); i++) {
+        if (std::string_view(Reflection::invokers[i].name) == name) {
+            return i;
+        }
+    }
+    std::fprintf(stderr, "no invoker for %s\n", name);
+    std::exit(1);
+}
+
+int main(int argc, char** argv) {
+    long calls = argc > 1 ? std::atol(argv[1]) : 100000000;
+
+    Templated object{{1.5f, 2}, {}};
+    // Look the thunks up once, as an RPC layer would when it binds a method.
+    auto get = Reflection::invokers[FindInvoker("get")].invoke;
+    auto params = Reflection::invokers[FindInvoker("params")].invoke;
+    std::function<name::Base()> get_function = [&] { return object.get(); };
+    std::function<void(float, const name::Base&, const whatever&)> params_function =
+        [&](float p1, const name::Base& p2, const whatever& p3) { object.params(p1, p2, p3); };
+
+    // Every variant folds its results into |sink|, so the calls cannot be dropped.
+    volatile float sink = 0;
+    auto direct_get = Seconds([&] {
+        for (long i = 0; i < calls; i++) {
+            object.data.a = static_cast<float>(i);
+            sink = sink + object.get().a;
+        }
+    });
+    auto thunk_get = Seconds([&] {
+        for (long i = 0; i < calls; i++) {
+            object.data.a = static_cast<float>(i);
+            alignas(name::Base) unsigned char result[sizeof(name::Base)];
+            get(&object, nullptr, result);
+            sink = sink + reinterpret_cast<name::Base*>(result)->a;
+        }
+    });
+    auto function_get = Seconds([&] {
+        for (long i = 0; i < calls; i++) {
+            object.data.a = static_cast<float>(i);
+            sink = sink + get_function().a;
+        }
+    });
+
+    name::Base base{3.0f, 4};
+    whatever nothing;
+    auto direct_params = Seconds([&] {
+        for (long i = 0; i < calls; i++) {
+            float p1 = static_cast<float>(i);
+            object.params(p1, base, nothing);
+            sink = sink + p1;
+        }
+    });
+    auto thunk_params = Seconds([&] {
+        for (long i = 0; i < calls; i++) {
+            float p1 = static_cast<float>(i);
+            void* args[] = {&p1, &base, &nothing};
+            params(&object, args, nullptr);
+            sink = sink + p1;
+        }
+    });
+    auto function_params = Seconds([&] {
+        for (long i = 0; i < calls; i++) {
+            float p1 = static_cast<float>(i);
+            params_function(p1, base, nothing);
+            sink = sink + p1;
+        }
+    });
+
+    std::printf("%ld calls each\n", calls);
+    Report("get() direct", direct_get, calls);
+    Report("get() thunk", thunk_get, calls);
+    Report("get() std::function", function_get, calls);
+    Report("params(float, Base, T1) direct", direct_params, calls);
+    Report("params(float, Base, T1) thunk", thunk_params, calls);
+    Report("params(float, Base, T1) std::function", function_params, calls);
+    return 0;
+}
@@ -0,0 +1,195 @@
+// Compares the generated streaming json_serializer against building and walking an llvm::json DOM for the same data.
+//
+// usage: refl_bench_json [elements per vector = 10000] [repetitions = 50]
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <llvm/Support/JSON.h>
+#include <llvm/Support/raw_ostream.h>
+
+#include "data_types.h"
+
+#include "json_reflect.h"
+
+namespace json = llvm::json;
+
+namespace name {
+static json::Value toJSON(const MyStruct& value) {
+    return json::Object{{"x", value.x}, {"y", value.y}};
+}
+static json::Value toJSON(const Base& value) {
+    return json::Object{{"a", value.a}, {"b", value.b}};
+}
+static bool fromJSON(const json::Value& value, MyStruct& out, json::Path path) {
+    json::ObjectMapper mapper(value, path);
+    double y = 0;
+    bool ok = mapper && mapper.map("x", out.x) && mapper.map("y", y);
+    out.y = static_cast<float>(y);
+    return ok;
+}
+static bool fromJSON(const json::Value& value, Base& out, json::Path path) {
+    json::ObjectMapper mapper(value, path);
+    double a = 0;
+    bool ok = mapper && mapper.map("a", a) && mapper.map("b", out.b);
+    out.a = static_cast<float>(a);
+    return ok;
+}
+static json::Value toJSON(Color value) {
+    return reflect<Color>::to_string(value);
+}
+static bool fromJSON(const json::Value& value, Color& out, json::Path path) {
+    auto name = value.getAsString();
+    if (!name || !reflect<Color>::from_string(*name, out)) {
+        path.report("expected a Color enumerator");
+        return false;
+    }
+    return true;
+}
+} // namespace name
+
+using Templated = MyTemplateStruct<name::Base, whatever>;
+
+static json::Value toJSON(const Templated& value) {
+    return json::Object{{"data", value.data}, {"data1", json::Object{}}};
+}
+static bool fromJSON(const json::Value& value, Templated& out, json::Path path) {
+    json::ObjectMapper mapper(value, path);
+    return mapper && mapper.map("data", out.data);
+}
+
+namespace bench {
+static json::Value toJSON(const Batch& value) {
+    return json::Object{
+        {"label", value.label},
+        {"structs", value.structs},
+        {"bases", value.bases},
+        {"templated", value.templated},
+        {"color", value.color},
+        {"sequence", static_cast<int64_t>(value.sequence)},
+    };
+}
+static bool fromJSON(const json::Value& value, Batch& out, json::Path path) {
+    json::ObjectMapper mapper(value, path);
+    int64_t sequence = 0;
+    bool ok = mapper && mapper.map("label", out.label) && mapper.map("structs", out.structs) &&
+              mapper.map("bases", out.bases) && mapper.map("templated", out.templated) &&
+              mapper.map("color", out.color) && mapper.map("sequence", sequence);
+    out.sequence = sequence;
+    return ok;
+}
+} // namespace bench
+
+template<typename T, typename = void>
+struct is_reflected : std::false_type {};
+template<typename T>
+struct is_reflected<T, std::void_t<decltype(reflect<T>::field_count)>> : std::true_type {};
+
+// Compares every field through reflect<T>. Fields without a json_serializer are not written, so they only have to be
+// default-constructed on both sides.
+template<typename T>
+bool SameContents(const T& a, const T& b);
+
+template<typename T>
+bool SameContents(const std::vector<T>& a, const std::vector<T>& b) {
+    if (a.size() != b.size()) {
+        return false;
+    }
+    for (std::size_t i = 0; i < a.size(); i++) {
+        if (!SameContents(a[i], b[i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+template<typename T>
+bool SameContents(const T& a, const T& b) {
+    if constexpr (is_reflected<T>::value) {
+        bool same = true;
+        reflect<T>::for_each_field([&](auto field) { same = same && SameContents(a.*(field.ptr), b.*(field.ptr)); });
+        return same;
+    } else if constexpr (!json_supported<T>::value) {
+        return true;
+    } else {
+        return a == b;
+    }
+}
+
+template<typename F>
+static double BestSeconds(int repetitions, F&& f) {
+    double best = 1e30;
+    for (int i = 0; i < repetitions; i++) {
+        auto start = std::chrono::steady_clock::now();
+        f();
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        best = std::min(best, elapsed.count());
+    }
+    return best;
+}
+
+static void Report(const char* label, double seconds, std::size_t bytes) {
+    std::printf("  %-24s %10.3f ms %10.1f MB/s\n", label, seconds * 1e3, bytes / seconds / 1e6);
+}
+
+int main(int argc, char** argv) {
+    int elements = argc > 1 ? std::atoi(argv[1]) : 10000;
+    int repetitions = argc > 2 ? std::atoi(argv[2]) : 50;
+
+    bench::Batch batch;
+    batch.label = "json benchmark";
+    batch.color = name::Color::blue;
+    batch.sequence = 42;
+    for (int i = 0; i < elements; i++) {
+        batch.structs.push_back({i, i * 0.5f});
+        batch.bases.push_back({i * 0.25f, -i});
+        batch.templated.push_back({{i * 2.0f, i}, {}});
+    }
+
+    std::string generated;
+    auto write_generated = BestSeconds(repetitions, [&] {
+        generated.clear();
+        to_json(batch, generated);
+    });
+    std::string dom;
+    auto write_dom = BestSeconds(repetitions, [&] {
+        dom.clear();
+        llvm::raw_string_ostream os(dom);
+        os << json::Value(bench::toJSON(batch));
+        os.flush();
+    });
+
+    // MyTemplateStruct<name::Base, whatever>::data1 has a type that is neither reflected nor fundamental, so it has no
+    // json_serializer and must be left out of the generated text.
+    if (generated.find("\"data1\"") != std::string::npos) {
+        std::fprintf(stderr, "field without a json_serializer was written\n");
+        return 1;
+    }
+
+    bool ok = true;
+    bench::Batch from_generated;
+    bench::Batch from_dom;
+    auto read_generated = BestSeconds(repetitions, [&] { ok = ok && from_json(generated, from_generated); });
+    auto read_dom = BestSeconds(repetitions, [&] {
+        auto value = json::parse(generated);
+        if (!value) {
+            llvm::consumeError(value.takeError());
+            ok = false;
+            return;
+        }
+        json::Path::Root root;
+        ok = ok && bench::fromJSON(*value, from_dom, root);
+    });
+    if (!ok || !SameContents(from_generated, batch) || !SameContents(from_dom, batch)) {
+        std::fprintf(stderr, "round trip failed\n");
+        return 1;
+    }
+
+    std::printf("3 vectors x %d elements, best of %d\n", elements, repetitions);
+    Report("generated write", write_generated, generated.size());
+    Report("llvm::json DOM write", write_dom, dom.size());
+    Report("generated read", read_generated, generated.size());
+    Report("llvm::json DOM read", read_dom, generated.size());
+    return 0;
+}
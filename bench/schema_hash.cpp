@@ -0,0 +1,89 @@
+// Checks that schema hashes follow the types a field stores through template arguments.
+//
+// usage: refl_check_schema_hash <refl>
+//
+// Two versions of a schema are written to the working directory that differ only in the fields of Point, which Path
+// holds as the element type of a std::vector. The generator writes a schema hash manifest for each, and the hash of
+// Path has to change with Point while the hash of the unrelated Other stays the same.
+
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <map>
+#include <string>
+
+static void WriteInput(const std::string& path, const char* point_fields) {
+    std::ofstream os(path);
+    os << "#include <vector>\n"
+          "namespace bench {\n"
+          "struct Point {\n"
+       << point_fields
+       << "};\n"
+          "struct Path {\n"
+          "    std::vector<Point> points;\n"
+          "};\n"
+          "struct Other {\n"
+          "    int value;\n"
+          "};\n"
+          "} // namespace bench\n"
+          "template<typename T, typename Enable = void>\n"
+          "struct reflect {\n"
+          "    static constexpr auto size = sizeof(T);\n"
+          "};\n"
+          "static_assert(sizeof(reflect<bench::Point>) > 0);\n"
+          "static_assert(sizeof(reflect<bench::Path>) > 0);\n"
+          "static_assert(sizeof(reflect<bench::Other>) > 0);\n";
+}
+
+static int Run(const std::string& command) {
+    return std::system(command.c_str());
+}
+
+// Type name to hash, from the "<hash> <type name>" lines of a manifest.
+static std::map<std::string, std::string> ReadManifest(const std::string& path) {
+    std::map<std::string, std::string> hashes;
+    std::ifstream is(path);
+    std::string hash;
+    std::string type_name;
+    while (is >> hash && std::getline(is >> std::ws, type_name)) {
+        hashes[type_name] = hash;
+    }
+    return hashes;
+}
+
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        std::fprintf(stderr, "usage: %s <refl>\n", argv[0]);
+        return 1;
+    }
+    std::string refl = argv[1];
+
+    WriteInput("schema_v1.cpp", "    int x;\n    int y;\n");
+    WriteInput("schema_v2.cpp", "    int x;\n    int y;\n    int z;\n");
+    if (Run(refl + " --schema-hash-manifest schema_v1.txt schema_v1.cpp -o schema_v1.h -- -std=c++17") != 0 ||
+        Run(refl + " --schema-hash-manifest schema_v2.txt schema_v2.cpp -o schema_v2.h -- -std=c++17") != 0) {
+        std::fprintf(stderr, "generator failed\n");
+        return 1;
+    }
+
+    auto v1 = ReadManifest("schema_v1.txt");
+    auto v2 = ReadManifest("schema_v2.txt");
+    bool ok = true;
+    auto expect = [&](const char* type_name, bool changed) {
+        if (!v1.count(type_name) || !v2.count(type_name)) {
+            std::fprintf(stderr, "%s: missing from the manifest\n", type_name);
+            ok = false;
+        } else if ((v1[type_name] != v2[type_name]) != changed) {
+            std::fprintf(stderr, "%s: hash %s\n", type_name, changed ? "did not change" : "changed");
+            ok = false;
+        }
+    };
+    expect("bench::Point", true);
+    expect("bench::Path", true);
+    expect("bench::Other", false);
+    if (!ok) {
+        return 1;
+    }
+    std::printf("schema hashes follow std::vector element types\n");
+    return 0;
+}
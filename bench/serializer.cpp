@@ -0,0 +1,180 @@
+// Compares the generated binary_serializer against a naive serializer that visits every field through
+// reflect<T>::for_each_field and writes it on its own.
+//
+// usage: refl_bench_serializer [elements per vector = 10000] [repetitions = 200]
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+
+#include "data_types.h"
+
+#include "serializer_reflect.h"
+
+template<typename T, typename = void>
+struct is_reflected : std::false_type {};
+template<typename T>
+struct is_reflected<T, std::void_t<decltype(reflect<T>::field_count)>> : std::true_type {};
+
+template<typename T>
+void NaiveWrite(binary_writer& writer, const T& value);
+
+template<typename T>
+void NaiveWrite(binary_writer& writer, const std::vector<T>& value) {
+    std::uint64_t size = value.size();
+    writer.write(&size, sizeof(size));
+    for (const auto& element : value) {
+        NaiveWrite(writer, element);
+    }
+}
+
+void NaiveWrite(binary_writer& writer, const std::string& value) {
+    std::uint64_t size = value.size();
+    writer.write(&size, sizeof(size));
+    writer.write(value.data(), value.size());
+}
+
+template<typename T>
+void NaiveWrite(binary_writer& writer, const T& value) {
+    if constexpr (is_reflected<T>::value) {
+        reflect<T>::for_each_field([&](auto field) { NaiveWrite(writer, value.*(field.ptr)); });
+    } else {
+        writer.write(&value, sizeof(T));
+    }
+}
+
+template<typename T>
+bool NaiveRead(binary_reader& reader, T& value);
+
+template<typename T>
+bool NaiveRead(binary_reader& reader, std::vector<T>& value) {
+    std::uint64_t size = 0;
+    if (!reader.read(&size, sizeof(size))) {
+        return false;
+    }
+    value.clear();
+    for (std::uint64_t i = 0; i < size; i++) {
+        T element{};
+        if (!NaiveRead(reader, element)) {
+            return false;
+        }
+        value.push_back(element);
+    }
+    return true;
+}
+
+bool NaiveRead(binary_reader& reader, std::string& value) {
+    std::uint64_t size = 0;
+    if (!reader.read(&size, sizeof(size)) || reader.size - reader.position < size) {
+        return false;
+    }
+    value.assign(reinterpret_cast<const char*>(reader.data + reader.position), static_cast<std::size_t>(size));
+    reader.position += static_cast<std::size_t>(size);
+    return true;
+}
+
+template<typename T>
+bool NaiveRead(binary_reader& reader, T& value) {
+    if constexpr (is_reflected<T>::value) {
+        bool ok = true;
+        reflect<T>::for_each_field([&](auto field) { ok = ok && NaiveRead(reader, value.*(field.ptr)); });
+        return ok;
+    } else {
+        return reader.read(&value, sizeof(T));
+    }
+}
+
+// Compares every field through reflect<T>, so that a serializer writing the wrong bytes fails the round trip.
+template<typename T>
+bool SameContents(const T& a, const T& b);
+
+template<typename T>
+bool SameContents(const std::vector<T>& a, const std::vector<T>& b) {
+    if (a.size() != b.size()) {
+        return false;
+    }
+    for (std::size_t i = 0; i < a.size(); i++) {
+        if (!SameContents(a[i], b[i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+template<typename T>
+bool SameContents(const T& a, const T& b) {
+    if constexpr (is_reflected<T>::value) {
+        bool same = true;
+        reflect<T>::for_each_field([&](auto field) { same = same && SameContents(a.*(field.ptr), b.*(field.ptr)); });
+        return same;
+    } else if constexpr (std::is_empty<T>::value) {
+        return true;
+    } else {
+        return a == b;
+    }
+}
+
+template<typename F>
+static double BestSeconds(int repetitions, F&& f) {
+    double best = 1e30;
+    for (int i = 0; i < repetitions; i++) {
+        auto start = std::chrono::steady_clock::now();
+        f();
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        best = std::min(best, elapsed.count());
+    }
+    return best;
+}
+
+static void Report(const char* label, double seconds, std::size_t bytes) {
+    std::printf("  %-28s %10.3f ms %10.1f MB/s\n", label, seconds * 1e3, bytes / seconds / 1e6);
+}
+
+int main(int argc, char** argv) {
+    int elements = argc > 1 ? std::atoi(argv[1]) : 10000;
+    int repetitions = argc > 2 ? std::atoi(argv[2]) : 200;
+
+    bench::Batch batch;
+    batch.label = "serializer benchmark";
+    batch.color = name::Color::blue;
+    batch.sequence = 42;
+    for (int i = 0; i < elements; i++) {
+        batch.structs.push_back({i, i * 0.5f});
+        batch.bases.push_back({i * 0.25f, -i});
+        batch.templated.push_back({{i * 2.0f, i}, {}});
+    }
+
+    std::vector<unsigned char> generated;
+    std::vector<unsigned char> naive;
+    auto write_generated = BestSeconds(repetitions, [&] {
+        generated.clear();
+        serialize(batch, generated);
+    });
+    auto write_naive = BestSeconds(repetitions, [&] {
+        naive.clear();
+        binary_writer writer{naive};
+        NaiveWrite(writer, batch);
+    });
+
+    bench::Batch from_generated;
+    bench::Batch from_naive;
+    bool ok = true;
+    auto read_generated = BestSeconds(
+        repetitions, [&] { ok = ok && deserialize(generated.data(), generated.size(), from_generated) != 0; });
+    auto read_naive = BestSeconds(repetitions, [&] {
+        binary_reader reader{naive.data(), naive.size()};
+        ok = ok && NaiveRead(reader, from_naive);
+    });
+    if (!ok || !SameContents(from_generated, batch) || !SameContents(from_naive, batch)) {
+        std::fprintf(stderr, "round trip failed\n");
+        return 1;
+    }
+
+    std::printf("3 vectors x %d elements, best of %d\n", elements, repetitions);
+    Report("generated serialize", write_generated, generated.size());
+    Report("naive per-field serialize", write_naive, naive.size());
+    Report("generated deserialize", read_generated, generated.size());
+    Report("naive per-field deserialize", read_naive, naive.size());
+    return 0;
+}
@@ -15,6 +15,14 @@ struct Derived : Base {
     void wtf(int damn) {}
 };
 
+// A const field keeps the type out of the emitters that assign fields.
+struct Versioned {
+    const int version = 1;
+    float value;
+};
+
+enum class Color : int { red, green, blue };
+
 } // namespace name
 
 struct whatever {};
@@ -39,6 +47,9 @@ struct MyTemplateStruct {
 void f() {
     using MyStructReflection = reflect<name::MyStruct>;
     using BaseReflection = reflect<name::Base>;
+    using DerivedReflection = reflect<name::Derived>;
+    using VersionedReflection = reflect<name::Versioned>;
+    using ColorReflection = reflect<name::Color>;
     using MyTemplateStructReflection = reflect<MyTemplateStruct<name::Base, whatever>>;
     constexpr auto fields = MyTemplateStructReflection::fields();
     constexpr auto methods = MyTemplateStructReflection::methods();
@@ -0,0 +1,446 @@
+#include "cache.h"
+
+#include <llvm/ADT/StringExtras.h>
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/JSON.h>
+#include <llvm/Support/MemoryBuffer.h>
+#include <llvm/Support/Path.h>
+#include <llvm/Support/raw_ostream.h>
+#include <llvm/Support/xxhash.h>
+
+#include "interner.h"
+
+// Bump whenever the layout of the data in reflection_data.h changes, so stale entries are ignored.
+constexpr int64_t cache_format_version = 13;
+
+namespace json = llvm::json;
+
+// json::ObjectMapper that reads strings and string lists into the interner, which ObjectMapper itself cannot do since
+// it only knows owning containers. Lists of other entries go to the arena as well.
+class InterningMapper {
+public:
+    InterningMapper(const json::Value& value, json::Path path)
+        : mapper_(value, path)
+        , object_(value.getAsObject())
+        , path_(path) {}
+
+    explicit operator bool() const {
+        return static_cast<bool>(mapper_);
+    }
+
+    template<typename T>
+    bool map(llvm::StringLiteral property, T& out) {
+        return mapper_.map(property, out);
+    }
+
+    bool map(llvm::StringLiteral property, llvm::StringRef& out) {
+        auto string = object_->getString(property);
+        if (!string) {
+            path_.field(property).report("expected string");
+            return false;
+        }
+        out = Intern(*string);
+        return true;
+    }
+
+    bool map(llvm::StringLiteral property, llvm::ArrayRef<llvm::StringRef>& out) {
+        std::vector<std::string> strings;
+        if (!mapper_.map(property, strings)) {
+            return false;
+        }
+        llvm::SmallVector<llvm::StringRef, 8> interned;
+        for (const auto& string : strings) {
+            interned.push_back(Intern(string));
+        }
+        out = Intern(interned);
+        return true;
+    }
+
+    template<typename T>
+    bool map(llvm::StringLiteral property, llvm::ArrayRef<T>& out) {
+        std::vector<T> values;
+        if (!mapper_.map(property, values)) {
+            return false;
+        }
+        out = ArenaCopy(llvm::makeArrayRef(values));
+        return true;
+    }
+
+    // std::vector<bool> hands out proxies instead of bool&, so flags are read one by one.
+    bool map(llvm::StringLiteral property, llvm::ArrayRef<bool>& out) {
+        const auto* array = object_->getArray(property);
+        if (!array) {
+            path_.field(property).report("expected array");
+            return false;
+        }
+        llvm::SmallVector<bool, 8> flags;
+        for (const auto& element : *array) {
+            auto flag = element.getAsBoolean();
+            if (!flag) {
+                path_.field(property).report("expected boolean");
+                return false;
+            }
+            flags.push_back(*flag);
+        }
+        out = ArenaCopy(llvm::makeArrayRef(flags));
+        return true;
+    }
+
+private:
+    json::ObjectMapper mapper_;
+    const json::Object* object_;
+    json::Path path_;
+};
+
+static json::Value toJSON(const TemplateParamData& param) {
+    return json::Object{
+        {"is_type", param.is_type},
+        {"name", param.name},
+        {"non_type_type_name", param.non_type_type_name},
+        {"non_type_value", param.non_type_value},
+        {"instantiated_type_name", param.instantiated_type_name},
+        {"canonical_type_name", param.canonical_type_name},
+    };
+}
+
+static bool fromJSON(const json::Value& value, TemplateParamData& param, json::Path path) {
+    InterningMapper mapper(value, path);
+    return mapper && mapper.map("is_type", param.is_type) && mapper.map("name", param.name) &&
+           mapper.map("non_type_type_name", param.non_type_type_name) &&
+           mapper.map("non_type_value", param.non_type_value) &&
+           mapper.map("instantiated_type_name", param.instantiated_type_name) &&
+           mapper.map("canonical_type_name", param.canonical_type_name);
+}
+
+static json::Value toJSON(const TypeData& type_data) {
+    return json::Object{
+        {"name", type_data.name},
+        {"qualified_name", type_data.qualified_name},
+        {"namespaces", json::Array(type_data.namespaces)},
+        {"is_templated", type_data.is_templated},
+        {"template_params", json::Array(type_data.template_params)},
+    };
+}
+
+static bool fromJSON(const json::Value& value, TypeData& type_data, json::Path path) {
+    InterningMapper mapper(value, path);
+    return mapper && mapper.map("name", type_data.name) && mapper.map("qualified_name", type_data.qualified_name) &&
+           mapper.map("namespaces", type_data.namespaces) && mapper.map("is_templated", type_data.is_templated) &&
+           mapper.map("template_params", type_data.template_params);
+}
+
+static json::Value toJSON(const FieldData& field) {
+    return json::Object{
+        {"name", field.name},
+        {"qualified_name", field.qualified_name},
+        {"qualified_type_name", field.qualified_type_name},
+        {"canonical_type_name", field.canonical_type_name},
+        {"stored_type_names", json::Array(field.stored_type_names)},
+        {"offset_bits", field.offset_bits},
+        {"size", field.size},
+        {"alignment", field.alignment},
+        {"is_bitfield", field.is_bitfield},
+        {"bit_width", field.bit_width},
+        {"is_trivially_copyable", field.is_trivially_copyable},
+        {"is_const", field.is_const},
+        {"is_reference", field.is_reference},
+        {"is_array", field.is_array},
+    };
+}
+
+static bool fromJSON(const json::Value& value, FieldData& field, json::Path path) {
+    InterningMapper mapper(value, path);
+    return mapper && mapper.map("name", field.name) && mapper.map("qualified_name", field.qualified_name) &&
+           mapper.map("qualified_type_name", field.qualified_type_name) &&
+           mapper.map("canonical_type_name", field.canonical_type_name) &&
+           mapper.map("stored_type_names", field.stored_type_names) &&
+           mapper.map("offset_bits", field.offset_bits) && mapper.map("size", field.size) &&
+           mapper.map("alignment", field.alignment) && mapper.map("is_bitfield", field.is_bitfield) &&
+           mapper.map("bit_width", field.bit_width) &&
+           mapper.map("is_trivially_copyable", field.is_trivially_copyable) &&
+           mapper.map("is_const", field.is_const) && mapper.map("is_reference", field.is_reference) &&
+           mapper.map("is_array", field.is_array);
+}
+
+static json::Value toJSON(const MethodData& method) {
+    return json::Object{
+        {"name", method.name},
+        {"qualified_name", method.qualified_name},
+        {"qualified_return_type_name", method.qualified_return_type_name},
+        {"method_qualified_type_name", method.method_qualified_type_name},
+        {"param_type_list", json::Array(method.param_type_list)},
+        {"canonical_return_type_name", method.canonical_return_type_name},
+        {"canonical_param_type_list", json::Array(method.canonical_param_type_list)},
+        {"lvalue_ref_params", json::Array(method.lvalue_ref_params)},
+        {"is_public", method.is_public},
+        {"is_deleted", method.is_deleted},
+        {"is_const", method.is_const},
+        {"is_rvalue_ref", method.is_rvalue_ref},
+    };
+}
+
+static bool fromJSON(const json::Value& value, MethodData& method, json::Path path) {
+    InterningMapper mapper(value, path);
+    return mapper && mapper.map("name", method.name) && mapper.map("qualified_name", method.qualified_name) &&
+           mapper.map("qualified_return_type_name", method.qualified_return_type_name) &&
+           mapper.map("method_qualified_type_name", method.method_qualified_type_name) &&
+           mapper.map("param_type_list", method.param_type_list) &&
+           mapper.map("canonical_return_type_name", method.canonical_return_type_name) &&
+           mapper.map("canonical_param_type_list", method.canonical_param_type_list) &&
+           mapper.map("lvalue_ref_params", method.lvalue_ref_params) &&
+           mapper.map("is_public", method.is_public) && mapper.map("is_deleted", method.is_deleted) &&
+           mapper.map("is_const", method.is_const) && mapper.map("is_rvalue_ref", method.is_rvalue_ref);
+}
+
+static json::Value toJSON(const LayoutRange& range) {
+    return json::Object{
+        {"offset", range.offset},
+        {"size", range.size},
+    };
+}
+
+static bool fromJSON(const json::Value& value, LayoutRange& range, json::Path path) {
+    InterningMapper mapper(value, path);
+    return mapper && mapper.map("offset", range.offset) && mapper.map("size", range.size);
+}
+
+static json::Value toJSON(const ReflectionData& reflection) {
+    return json::Object{
+        {"qualified_type_name", reflection.qualified_type_name},
+        {"canonical_type_name", reflection.canonical_type_name},
+        {"fields", json::Array(reflection.fields)},
+        {"methods", json::Array(reflection.methods)},
+        {"has_layout", reflection.has_layout},
+        {"size", reflection.size},
+        {"alignment", reflection.alignment},
+        {"is_trivially_copyable", reflection.is_trivially_copyable},
+        {"is_standard_layout", reflection.is_standard_layout},
+        {"opaque_ranges", json::Array(reflection.opaque_ranges)},
+    };
+}
+
+static bool fromJSON(const json::Value& value, ReflectionData& reflection, json::Path path) {
+    InterningMapper mapper(value, path);
+    return mapper && mapper.map("qualified_type_name", reflection.qualified_type_name) &&
+           mapper.map("canonical_type_name", reflection.canonical_type_name) &&
+           mapper.map("fields", reflection.fields) && mapper.map("methods", reflection.methods) &&
+           mapper.map("has_layout", reflection.has_layout) && mapper.map("size", reflection.size) &&
+           mapper.map("alignment", reflection.alignment) &&
+           mapper.map("is_trivially_copyable", reflection.is_trivially_copyable) &&
+           mapper.map("is_standard_layout", reflection.is_standard_layout) &&
+           mapper.map("opaque_ranges", reflection.opaque_ranges);
+}
+
+static json::Value toJSON(const EnumeratorData& enumerator) {
+    return json::Object{
+        {"name", enumerator.name},
+        {"value", enumerator.value},
+    };
+}
+
+static bool fromJSON(const json::Value& value, EnumeratorData& enumerator, json::Path path) {
+    InterningMapper mapper(value, path);
+    return mapper && mapper.map("name", enumerator.name) && mapper.map("value", enumerator.value);
+}
+
+static json::Value toJSON(const EnumData& enum_data) {
+    return json::Object{
+        {"qualified_type_name", enum_data.qualified_type_name},
+        {"canonical_type_name", enum_data.canonical_type_name},
+        {"name", enum_data.name},
+        {"namespaces", json::Array(enum_data.namespaces)},
+        {"underlying_type_name", enum_data.underlying_type_name},
+        {"is_scoped", enum_data.is_scoped},
+        {"is_signed", enum_data.is_signed},
+        {"can_forward_declare", enum_data.can_forward_declare},
+        {"enumerators", json::Array(enum_data.enumerators)},
+    };
+}
+
+static bool fromJSON(const json::Value& value, EnumData& enum_data, json::Path path) {
+    InterningMapper mapper(value, path);
+    return mapper && mapper.map("qualified_type_name", enum_data.qualified_type_name) &&
+           mapper.map("canonical_type_name", enum_data.canonical_type_name) && mapper.map("name", enum_data.name) &&
+           mapper.map("namespaces", enum_data.namespaces) &&
+           mapper.map("underlying_type_name", enum_data.underlying_type_name) &&
+           mapper.map("is_scoped", enum_data.is_scoped) && mapper.map("is_signed", enum_data.is_signed) &&
+           mapper.map("can_forward_declare", enum_data.can_forward_declare) &&
+           mapper.map("enumerators", enum_data.enumerators);
+}
+
+ReflectionCache::ReflectionCache(std::string directory, std::string configuration)
+    : directory_(std::move(directory))
+    , configuration_(std::move(configuration)) {
+    if (auto error = llvm::sys::fs::create_directories(directory_)) {
+        llvm::errs() << "cannot create cache directory " << directory_ << ": " << error.message() << "\n";
+    }
+}
+
+std::string ReflectionCache::EntryPath(llvm::StringRef source,
+                                       llvm::ArrayRef<clang::tooling::CompileCommand> commands) const {
+    std::string key;
+    llvm::raw_string_ostream os(key);
+    os << configuration_ << '\0' << source << '\0';
+    for (const auto& command : commands) {
+        os << command.Directory << '\0' << command.Filename << '\0';
+        for (const auto& arg : command.CommandLine) {
+            os << arg << '\0';
+        }
+    }
+    llvm::SmallString<256> path(directory_);
+    llvm::sys::path::append(path, llvm::utohexstr(llvm::xxHash64(os.str()), /*LowerCase=*/true) + ".json");
+    return std::string(path);
+}
+
+uint64_t ReflectionCache::HashContents(llvm::StringRef contents) {
+    return llvm::xxHash64(contents);
+}
+
+static std::optional<uint64_t> ReadFileHash(llvm::StringRef path) {
+    if (auto buffer = llvm::MemoryBuffer::getFile(path)) {
+        return ReflectionCache::HashContents((*buffer)->getBuffer());
+    }
+    return std::nullopt;
+}
+
+std::optional<uint64_t> ReflectionCache::HashFile(llvm::StringRef path) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = file_hashes_.find(path);
+        if (it != file_hashes_.end()) {
+            return it->second;
+        }
+    }
+    auto hash = ReadFileHash(path);
+    std::lock_guard<std::mutex> lock(mutex_);
+    file_hashes_.try_emplace(path, hash);
+    return hash;
+}
+
+void ReflectionCache::ForgetFileHashes() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    file_hashes_.clear();
+}
+
+bool ReflectionCache::Load(llvm::StringRef source,
+                           llvm::ArrayRef<clang::tooling::CompileCommand> commands,
+                           ReflectionResult& result,
+                           std::vector<std::string>& dependencies) {
+    auto buffer = llvm::MemoryBuffer::getFile(EntryPath(source, commands));
+    if (!buffer) {
+        return false;
+    }
+    auto entry = json::parse((*buffer)->getBuffer());
+    if (!entry) {
+        llvm::consumeError(entry.takeError());
+        return false;
+    }
+    auto* object = entry->getAsObject();
+    if (!object || object->getInteger("version") != cache_format_version) {
+        return false;
+    }
+
+    // The source itself is one of the dependencies, so this also covers the TU's own content hash.
+    auto* dependency_array = object->getArray("dependencies");
+    if (!dependency_array) {
+        return false;
+    }
+    std::vector<std::string> dependency_paths;
+    for (const auto& dependency : *dependency_array) {
+        auto* dependency_object = dependency.getAsObject();
+        if (!dependency_object) {
+            return false;
+        }
+        auto path = dependency_object->getString("path");
+        auto hash = dependency_object->getString("hash");
+        if (!path || !hash) {
+            return false;
+        }
+        auto current_hash = HashFile(*path);
+        if (!current_hash || llvm::utohexstr(*current_hash, /*LowerCase=*/true) != *hash) {
+            return false;
+        }
+        dependency_paths.emplace_back(*path);
+    }
+
+    std::vector<TypeData> type_infos;
+    std::vector<ReflectionData> reflections;
+    std::vector<EnumData> enums;
+    auto* type_infos_value = object->get("type_infos");
+    auto* reflections_value = object->get("reflections");
+    auto* enums_value = object->get("enums");
+    json::Path::Root root;
+    if (!type_infos_value || !reflections_value || !enums_value || !fromJSON(*type_infos_value, type_infos, root) ||
+        !fromJSON(*reflections_value, reflections, root) || !fromJSON(*enums_value, enums, root)) {
+        llvm::consumeError(root.getError());
+        return false;
+    }
+    for (const auto& type_data : type_infos) {
+        result.type_infos.try_emplace(type_data.qualified_name, type_data);
+    }
+    for (const auto& reflection : reflections) {
+        result.reflection_table.try_emplace(reflection.qualified_type_name, reflection);
+    }
+    for (const auto& enum_data : enums) {
+        result.enum_table.try_emplace(enum_data.qualified_type_name, enum_data);
+    }
+    dependencies = std::move(dependency_paths);
+    return true;
+}
+
+void ReflectionCache::Store(llvm::StringRef source,
+                            llvm::ArrayRef<clang::tooling::CompileCommand> commands,
+                            const ReflectionResult& result,
+                            llvm::ArrayRef<std::string> dependencies,
+                            const llvm::StringMap<uint64_t>& read_hashes) {
+    json::Array dependency_array;
+    for (const auto& dependency : dependencies) {
+        // Read again rather than remembered: a file may have been rewritten since an earlier Load() hashed it.
+        auto hash = ReadFileHash(dependency);
+        if (!hash) {
+            return; // a file vanished while we were parsing, the entry could never be validated
+        }
+        auto read_hash = read_hashes.find(dependency);
+        if (read_hash != read_hashes.end() && read_hash->second != *hash) {
+            return; // the result describes contents that are gone, a later run has to parse again
+        }
+        dependency_array.push_back(json::Object{
+            {"path", dependency},
+            {"hash", llvm::utohexstr(*hash, /*LowerCase=*/true)},
+        });
+    }
+    json::Array type_infos;
+    for (const auto& [type_name, type_data] : result.type_infos) {
+        type_infos.push_back(toJSON(type_data));
+    }
+    json::Array reflections;
+    for (const auto& [type_name, reflection] : result.reflection_table) {
+        reflections.push_back(toJSON(reflection));
+    }
+    json::Array enums;
+    for (const auto& [type_name, enum_data] : result.enum_table) {
+        enums.push_back(toJSON(enum_data));
+    }
+    json::Object entry{
+        {"version", cache_format_version},
+        {"dependencies", std::move(dependency_array)},
+        {"type_infos", std::move(type_infos)},
+        {"reflections", std::move(reflections)},
+        {"enums", std::move(enums)},
+    };
+
+    // Write to a temporary and rename, so that concurrent runs never observe a half written entry.
+    auto entry_path = EntryPath(source, commands);
+    int fd;
+    llvm::SmallString<256> temp_path;
+    if (llvm::sys::fs::createUniqueFile(entry_path + ".%%%%%%.tmp", fd, temp_path)) {
+        return;
+    }
+    {
+        llvm::raw_fd_ostream os(fd, /*shouldClose=*/true);
+        os << json::Value(std::move(entry));
+    }
+    if (llvm::sys::fs::rename(temp_path, entry_path)) {
+        llvm::sys::fs::remove(temp_path);
+    }
+}
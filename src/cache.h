@@ -0,0 +1,52 @@
+#pragma once
+
+#include <clang/Tooling/CompilationDatabase.h>
+#include <llvm/ADT/ArrayRef.h>
+#include <llvm/ADT/StringMap.h>
+#include <llvm/ADT/StringRef.h>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "reflection_data.h"
+
+// On-disk cache of the reflection data each translation unit produced. An entry is addressed by the source path and
+// its compile commands, and is only reused while the source and every file it read still hash to the stored values.
+// Safe to use from several threads at once.
+class ReflectionCache {
+public:
+    // |configuration| describes tool options that change what is extracted from a TU and is mixed into every key.
+    ReflectionCache(std::string directory, std::string configuration);
+
+    // Fills |result| and |dependencies| and returns true if a valid entry exists for |source| compiled with |commands|.
+    bool Load(llvm::StringRef source,
+              llvm::ArrayRef<clang::tooling::CompileCommand> commands,
+              ReflectionResult& result,
+              std::vector<std::string>& dependencies);
+
+    // Records |result| for |source|. |dependencies| are absolute paths of every file the TU read, the source included.
+    // |read_hashes| holds the HashContents() of what the parser read for the files it loaded; nothing is stored when
+    // one of them differs from the file on disk, which was then edited during the parse. Other files are hashed now.
+    void Store(llvm::StringRef source,
+               llvm::ArrayRef<clang::tooling::CompileCommand> commands,
+               const ReflectionResult& result,
+               llvm::ArrayRef<std::string> dependencies,
+               const llvm::StringMap<uint64_t>& read_hashes);
+
+    // Drops the file hashes remembered by Load(). A resident process calls this before every run, as files may have
+    // changed since the last one.
+    void ForgetFileHashes();
+
+    // The hash entries record for a file with |contents|.
+    static uint64_t HashContents(llvm::StringRef contents);
+
+private:
+    std::string EntryPath(llvm::StringRef source, llvm::ArrayRef<clang::tooling::CompileCommand> commands) const;
+    std::optional<uint64_t> HashFile(llvm::StringRef path);
+
+    std::string directory_;
+    std::string configuration_;
+    std::mutex mutex_;
+    llvm::StringMap<std::optional<uint64_t>> file_hashes_; // files do not change during a run, hash each one once
+};
@@ -0,0 +1,504 @@
+#include "emitter.h"
+
+#include <llvm/ADT/SmallVector.h>
+#include <llvm/ADT/StringSet.h>
+#include <llvm/Support/Format.h>
+#include <set>
+
+#include "enum_emitter.h"
+#include "layout.h"
+#include "json_emitter.h"
+#include "perfect_hash.h"
+#include "registry.h"
+#include "serializer_emitter.h"
+#include "soa_emitter.h"
+
+// Names are std::string_view rather than std::string so that fields() and methods() stay usable in constant
+// expressions, as data/test.cpp does.
+static constexpr llvm::StringLiteral tuple_preamble_helpers = R"(
+template<class T, class V = void>
+struct member_info {
+    using value_type = V;
+    std::string_view name;
+    V T::* ptr = nullptr;
+};
+
+template<typename T, typename F>
+struct method_info {
+    using method_type = F;
+    std::string_view name;
+    F func_ptr;
+};
+)";
+
+static constexpr llvm::StringLiteral descriptor_preamble_helpers = R"(
+template<class T, class V = void>
+struct field_descriptor {
+    using value_type = V;
+    const char* name;
+    V T::* ptr;
+};
+
+template<typename T, typename F>
+struct method_descriptor {
+    using method_type = F;
+    const char* name;
+    F func_ptr;
+};
+)";
+
+// Must compute the same values as NameHash() in perfect_hash.h.
+static constexpr llvm::StringLiteral name_hash_preamble_helpers = R"(
+constexpr std::uint64_t reflect_name_hash(std::string_view name, std::uint64_t seed) {
+    std::uint64_t hash = 0xcbf29ce484222325ull ^ seed;
+    for (char c : name) {
+        hash ^= static_cast<unsigned char>(c);
+        hash *= 0x100000001b3ull;
+    }
+    hash ^= hash >> 33;
+    hash *= 0xff51afd7ed558ccdull;
+    hash ^= hash >> 33;
+    return hash;
+}
+)";
+
+static constexpr llvm::StringLiteral layout_preamble_helpers = R"(
+struct field_layout {
+    std::size_t offset; // byte holding the first bit for bit-fields
+    std::size_t size;   // 0 for bit-fields
+    std::size_t alignment;
+    bool is_bitfield;
+};
+
+struct layout_range {
+    std::size_t offset;
+    std::size_t size;
+};
+
+struct copy_run {
+    std::size_t offset;
+    std::size_t size;
+    std::size_t first_field;
+    std::size_t field_count;
+};
+)";
+
+static constexpr llvm::StringLiteral invoker_preamble_helpers = R"(
+// Calls a method on |object| with arguments pointed to by |args|, one per parameter, each pointing to an object of the
+// parameter's type without reference. Arguments of parameters that are not lvalue references are moved from. Values
+// are returned by constructing them in the uninitialized storage at |result|, which the caller destroys; references
+// are returned as a pointer stored at |result|; for void methods |result| is unused.
+using method_thunk = void (*)(void* object, void* const* args, void* result);
+
+struct method_invoker {
+    const char* name;
+    method_thunk invoke; // nullptr for methods that cannot be called from outside, deleted or not public
+    std::size_t arg_count;
+};
+
+template<typename F>
+void reflect_store_result(void* result, F&& call) {
+    using R = decltype(call());
+    if constexpr (std::is_void<R>::value) {
+        call();
+    } else if constexpr (std::is_reference<R>::value) {
+        // Bound first since the address of an xvalue cannot be taken directly.
+        auto&& reference = call();
+        *static_cast<std::remove_reference_t<R>**>(result) = std::addressof(reference);
+    } else {
+        ::new (result) R(call());
+    }
+}
+)";
+
+static constexpr llvm::StringLiteral reflect_primary_template = R"(
+template<typename T, typename Enable = void>
+struct reflect {
+private:
+    static constexpr auto size = sizeof(T); // always trigger instantiation if T is templated
+};
+)";
+
+void EmitForwardDeclaration(llvm::raw_ostream& os, const TypeData& type_data) {
+    // Namespaces are qualified, the innermost one alone names the whole chain.
+    if (!type_data.namespaces.empty()) {
+        os << "namespace " << type_data.namespaces.back() << " {\n";
+    }
+    if (type_data.is_templated) {
+        os << "template <";
+        for (size_t i = 0; i < type_data.template_params.size(); i++) {
+            const auto& p = type_data.template_params[i];
+            os << (i == 0 ? "" : ", ") << (p.is_type ? llvm::StringRef("typename") : p.non_type_type_name) << ' '
+               << p.name;
+        }
+        os << "> struct " << type_data.name << ";\n";
+    } else {
+        os << "struct " << type_data.name << ";\n";
+    }
+    if (!type_data.namespaces.empty()) {
+        os << "}\n";
+    }
+}
+
+// fields()/methods() returning every member at once as a std::tuple.
+static void EmitTupleMembers(llvm::raw_ostream& os, const ReflectionData& reflection) {
+    os << "    static constexpr auto fields() {\n"
+          "        return std::make_tuple(\n";
+    for (size_t i = 0; i < reflection.fields.size(); i++) {
+        const auto& name = reflection.fields[i].name;
+        os << "            member_info<T, decltype(T::" << name << ")>{ \"" << name << "\", &T::" << name << " }"
+           << (i == reflection.fields.size() - 1 ? "" : ",") << '\n';
+    }
+    os << "        );\n"
+          "    }\n";
+
+    os << "    static constexpr auto methods() {\n"
+          "        return std::make_tuple(\n";
+    for (size_t i = 0; i < reflection.methods.size(); i++) {
+        const auto& name = reflection.methods[i].name;
+        os << "            method_info<T, decltype(&T::" << name << ")>{ \"" << name << "\", &T::" << name << " }"
+           << (i == reflection.methods.size() - 1 ? "" : ",") << '\n';
+    }
+    os << "        );\n"
+          "    }\n";
+}
+
+// Descriptor accessors for one kind of member. Every descriptor has its own overload selected by an index tag, so a
+// consumer only instantiates the members it touches, and for_each_* is a straight line of calls that needs no
+// std::tuple, index_sequence or recursive instantiation.
+template<typename Member>
+static void EmitDescriptorMembers(llvm::raw_ostream& os,
+                                  llvm::ArrayRef<Member> members,
+                                  llvm::StringRef kind,
+                                  llvm::StringRef descriptor,
+                                  llvm::StringRef member_prefix) {
+    os << "    static constexpr std::size_t " << kind << "_count = " << members.size() << ";\n";
+
+    os << "    static constexpr const char * " << kind << "_name(std::size_t i) {\n"
+       << "        switch (i) {\n";
+    for (size_t i = 0; i < members.size(); i++) {
+        os << "            case " << i << ": return \"" << members[i].name << "\";\n";
+    }
+    os << "            default: return nullptr;\n"
+          "        }\n"
+          "    }\n";
+
+    for (size_t i = 0; i < members.size(); i++) {
+        const auto& name = members[i].name;
+        os << "    static constexpr auto " << kind << "(std::integral_constant<std::size_t, " << i << ">) { return "
+           << descriptor << "<T, decltype(" << member_prefix << name << ")>{ \"" << name << "\", &T::" << name
+           << " }; }\n";
+    }
+    os << "    template <std::size_t I> static constexpr auto " << kind << "() { return " << kind
+       << "(std::integral_constant<std::size_t, I>{}); }\n";
+
+    os << "    template <typename F> static constexpr void for_each_" << kind << "(F&& f) {\n";
+    for (size_t i = 0; i < members.size(); i++) {
+        const auto& name = members[i].name;
+        os << "        f(" << descriptor << "<T, decltype(" << member_prefix << name << ")>{ \"" << name << "\", &T::"
+           << name << " });\n";
+    }
+    if (members.empty()) {
+        os << "        (void)f;\n";
+    }
+    os << "    }\n";
+}
+
+// <kind>_index_of(name) backed by a perfect hash built here, and visit_<kind>(name, f) calling f with the member's
+// descriptor through a switch on that index. Overloads share a name, which resolves to the first of them.
+template<typename Member>
+static void EmitNameLookup(llvm::raw_ostream& os,
+                           llvm::ArrayRef<Member> members,
+                           llvm::StringRef kind,
+                           const EmitOptions& options) {
+    llvm::SmallVector<llvm::StringRef, 16> names;
+    llvm::SmallVector<size_t, 16> indices;
+    llvm::StringSet<> seen;
+    for (size_t i = 0; i < members.size(); i++) {
+        if (seen.insert(members[i].name).second) {
+            names.push_back(members[i].name);
+            indices.push_back(i);
+        }
+    }
+
+    if (names.empty()) {
+        os << "    static constexpr std::size_t " << kind << "_index_of(std::string_view) { return npos; }\n"
+           << "    template <typename F> static constexpr bool visit_" << kind
+           << "(std::string_view, F&&) { return false; }\n";
+        return;
+    }
+
+    auto table = BuildPerfectHash(names);
+    os << "    static constexpr std::uint32_t " << kind << "_hash_seeds[] = {";
+    for (size_t i = 0; i < table.seeds.size(); i++) {
+        os << (i == 0 ? " " : ", ") << table.seeds[i];
+    }
+    os << " };\n";
+    // Slots hold positions in the deduplicated name list, or names.size() when empty.
+    os << "    static constexpr " << (names.size() < 0xffff ? "std::uint16_t " : "std::uint32_t ") << kind
+       << "_hash_slots[] = {";
+    for (size_t i = 0; i < table.slots.size(); i++) {
+        os << (i == 0 ? " " : ", ") << table.slots[i];
+    }
+    os << " };\n";
+    os << "    static constexpr std::string_view " << kind << "_hash_names[] = {";
+    for (size_t i = 0; i < names.size(); i++) {
+        os << (i == 0 ? " \"" : ", \"") << names[i] << '"';
+    }
+    os << " };\n";
+    os << "    static constexpr std::size_t " << kind << "_hash_indices[] = {";
+    for (size_t i = 0; i < indices.size(); i++) {
+        os << (i == 0 ? " " : ", ") << indices[i];
+    }
+    os << " };\n";
+
+    os << "    static constexpr std::size_t " << kind << "_index_of(std::string_view name) {\n"
+       << "        const auto seed = " << kind << "_hash_seeds[reflect_name_hash(name, 0) & "
+       << table.seeds.size() - 1 << "];\n"
+       << "        const std::size_t slot = " << kind << "_hash_slots[reflect_name_hash(name, seed) & "
+       << table.slots.size() - 1 << "];\n"
+       << "        return slot < " << names.size() << " && " << kind << "_hash_names[slot] == name ? " << kind
+       << "_hash_indices[slot] : npos;\n"
+       << "    }\n";
+
+    os << "    template <typename F> static constexpr bool visit_" << kind << "(std::string_view name, F&& f) {\n"
+       << "        switch (" << kind << "_index_of(name)) {\n";
+    for (auto i : indices) {
+        os << "            case " << i << ": f(";
+        if (options.descriptors) {
+            os << kind << "<" << i << ">()";
+        } else {
+            os << "std::get<" << i << ">(" << kind << "s())";
+        }
+        os << "); return true;\n";
+    }
+    os << "            default: return false;\n"
+          "        }\n"
+          "    }\n";
+}
+
+// Layout as computed for the target the tool ran for. The static_assert catches consumers compiled for another one.
+static void EmitLayout(llvm::raw_ostream& os, const ReflectionData& reflection) {
+    if (!reflection.has_layout) {
+        return;
+    }
+    os << "    static_assert(sizeof(T) == " << reflection.size << " && alignof(T) == " << reflection.alignment
+       << ", \"layout of " << reflection.qualified_type_name << " differs from the reflected one\");\n"
+       << "    static constexpr std::size_t type_size = " << reflection.size << ";\n"
+       << "    static constexpr std::size_t type_alignment = " << reflection.alignment << ";\n"
+       << "    static constexpr bool is_trivially_copyable = "
+       << (reflection.is_trivially_copyable ? "true" : "false") << ";\n"
+       << "    static constexpr bool is_standard_layout = " << (reflection.is_standard_layout ? "true" : "false")
+       << ";\n";
+
+    os << "    static constexpr std::array<field_layout, " << reflection.fields.size() << "> field_layouts = {{";
+    for (size_t i = 0; i < reflection.fields.size(); i++) {
+        const auto& field = reflection.fields[i];
+        os << (i == 0 ? " " : ", ") << '{' << field.offset_bits / 8 << ", " << field.size << ", "
+           << field.alignment << ", " << (field.is_bitfield ? "true" : "false") << '}';
+    }
+    os << " }};\n";
+
+    auto holes = ComputePaddingHoles(reflection);
+    uint64_t padding_bytes = 0;
+    os << "    static constexpr std::array<layout_range, " << holes.size() << "> padding = {{";
+    for (size_t i = 0; i < holes.size(); i++) {
+        os << (i == 0 ? " " : ", ") << '{' << holes[i].offset << ", " << holes[i].size << '}';
+        padding_bytes += holes[i].size;
+    }
+    os << " }};\n"
+       << "    static constexpr std::size_t padding_bytes = " << padding_bytes << ";\n";
+
+    auto runs = ComputeCopyRuns(reflection);
+    os << "    static constexpr std::array<copy_run, " << runs.size() << "> copy_runs = {{";
+    for (size_t i = 0; i < runs.size(); i++) {
+        os << (i == 0 ? " " : ", ") << '{' << runs[i].offset << ", " << runs[i].size << ", " << runs[i].first_field
+           << ", " << runs[i].field_count << '}';
+    }
+    os << " }};\n";
+}
+
+// One thunk per callable method and invokers, indexed like the methods, pointing at them. Arguments are unpacked
+// with the parameter types spelled in param_type_list, which also selects the right overload. The argument storage
+// belongs to the call, so everything but lvalue reference parameters is moved in.
+static void EmitInvokers(llvm::raw_ostream& os, const ReflectionData& reflection) {
+    const auto& methods = reflection.methods;
+    for (size_t i = 0; i < methods.size(); i++) {
+        const auto& method = methods[i];
+        if (!method.is_public || method.is_deleted) {
+            continue;
+        }
+        // The object is cast with the method's own qualifiers so that const and non-const overloads each call
+        // themselves and && methods are called on an rvalue.
+        llvm::StringRef object_type = method.is_const ? "const T*" : "T*";
+        os << "    static void invoke_" << i << "(void* object, void* const* args, void* result) {\n"
+           << "        reflect_store_result(result, [&]() -> decltype(auto) {\n";
+        if (method.is_rvalue_ref) {
+            os << "            return std::move(*static_cast<" << object_type << ">(object))." << method.name << '(';
+        } else {
+            os << "            return static_cast<" << object_type << ">(object)->" << method.name << '(';
+        }
+        for (size_t arg = 0; arg < method.param_type_list.size(); arg++) {
+            llvm::StringRef type = method.param_type_list[arg];
+            bool rvalue = !method.lvalue_ref_params[arg];
+            os << (arg == 0 ? "" : ", ") << (rvalue ? "std::move(" : "") << "*static_cast<std::remove_reference_t<"
+               << type << ">*>(args[" << arg << "])" << (rvalue ? ")" : "");
+        }
+        os << ");\n"
+              "        });\n";
+        if (method.param_type_list.empty()) {
+            os << "        (void)args;\n";
+        }
+        os << "    }\n";
+    }
+    os << "    static constexpr std::array<method_invoker, " << methods.size() << "> invokers = {{";
+    for (size_t i = 0; i < methods.size(); i++) {
+        const auto& method = methods[i];
+        os << (i == 0 ? " " : ", ") << "{ \"" << method.name << "\", ";
+        if (!method.is_public || method.is_deleted) {
+            os << "nullptr";
+        } else {
+            os << "&invoke_" << i;
+        }
+        os << ", " << method.param_type_list.size() << " }";
+    }
+    os << " }};\n";
+}
+
+void EmitClassReflection(llvm::raw_ostream& os, const ReflectionData& reflection, const EmitOptions& options) {
+    const auto& type_name = reflection.qualified_type_name;
+    os << "\ntemplate <typename T> struct reflect<T, typename std::enable_if<std::is_same<T, " << type_name
+       << ">::value, void >::type> {\n";
+    os << "    static constexpr const char * type_name() { return \"" << type_name << "\"; }\n";
+    if (options.descriptors) {
+        EmitDescriptorMembers(os, reflection.fields, "field", "field_descriptor", "T::");
+        EmitDescriptorMembers(os, reflection.methods, "method", "method_descriptor", "&T::");
+    } else {
+        EmitTupleMembers(os, reflection);
+    }
+    if (options.name_lookup) {
+        os << "    static constexpr std::size_t npos = static_cast<std::size_t>(-1);\n";
+        EmitNameLookup(os, reflection.fields, "field", options);
+        EmitNameLookup(os, reflection.methods, "method", options);
+    }
+    if (options.layout) {
+        EmitLayout(os, reflection);
+    }
+    if (options.invokers) {
+        EmitInvokers(os, reflection);
+    }
+    if (options.schema_hash) {
+        os << "    static constexpr std::uint64_t schema_hash = " << llvm::format_hex(reflection.schema_hash, 18)
+           << "ull;\n";
+    }
+    os << "};\n";
+    if (options.soa) {
+        EmitSoaVector(os, reflection);
+    }
+    if (options.serializer) {
+        EmitSerializer(os, reflection);
+    }
+    if (options.json) {
+        EmitJsonSerializer(os, reflection);
+    }
+}
+
+void EmitPreamble(llvm::raw_ostream& os,
+                  const ReflectionResult& result,
+                  const EmitOptions& options,
+                  bool forward_declarations) {
+    os << "#pragma once\n"
+          "// preamble-begin\n";
+    std::set<llvm::StringRef> includes{"type_traits"};
+    if (options.descriptors) {
+        includes.insert("cstddef");
+    } else {
+        includes.insert({"string_view", "tuple"});
+    }
+    if (options.name_lookup) {
+        includes.insert({"cstddef", "cstdint", "string_view"});
+    }
+    if (options.layout) {
+        includes.insert({"array", "cstddef"});
+    }
+    if (options.soa) {
+        includes.insert({"cstddef", "memory", "new", "utility", "vector"});
+    }
+    if (options.serializer) {
+        includes.insert({"cstddef", "cstdint", "cstring", "string", "utility", "vector"});
+    }
+    if (options.registry) {
+        includes.insert({"array", "cstddef", "cstdint", "cstring", "string_view"});
+    }
+    if (options.invokers) {
+        includes.insert({"array", "cstddef", "memory", "new", "utility"});
+    }
+    if (options.schema_hash) {
+        includes.insert("cstdint");
+    }
+    if (!result.enum_table.empty()) {
+        includes.insert({"array", "cstddef", "cstdint", "string_view"});
+    }
+    if (options.json) {
+        includes.insert({"charconv", "clocale", "cmath", "cstddef", "cstdint", "cstdio", "cstdlib", "limits",
+                         "string", "string_view", "vector"});
+    }
+    for (auto include : includes) {
+        os << "#include <" << include << ">\n";
+    }
+    os << (options.descriptors ? descriptor_preamble_helpers : tuple_preamble_helpers);
+    if (options.name_lookup || options.json || !result.enum_table.empty()) {
+        os << name_hash_preamble_helpers;
+    }
+    if (options.layout) {
+        os << layout_preamble_helpers;
+    }
+    if (options.soa) {
+        EmitSoaPreamble(os);
+    }
+    if (options.serializer) {
+        EmitSerializerPreamble(os);
+    }
+    if (options.json) {
+        EmitJsonPreamble(os);
+    }
+    if (options.registry) {
+        EmitRegistryPreamble(os);
+    }
+    if (options.invokers) {
+        os << invoker_preamble_helpers;
+    }
+    os << reflect_primary_template << '\n';
+    if (forward_declarations) {
+        for (const auto& [type_name, type_data] : result.type_infos) {
+            EmitForwardDeclaration(os, type_data);
+        }
+        for (const auto& [type_name, enum_data] : result.enum_table) {
+            EmitEnumForwardDeclaration(os, enum_data);
+        }
+    }
+    os << "// preamble-end\n";
+}
+
+void EmitReflections(llvm::raw_ostream& os, const ReflectionResult& result, const EmitOptions& options) {
+    os << "// reflection-begin\n";
+    for (const auto& [type_name, reflection] : result.reflection_table) {
+        EmitClassReflection(os, reflection, options);
+    }
+    for (const auto& [type_name, enum_data] : result.enum_table) {
+        EmitEnumReflection(os, enum_data);
+        if (options.json) {
+            EmitJsonEnumSerializer(os, enum_data);
+        }
+    }
+    os << "// reflection-end\n";
+}
+
+void EmitReflectionFile(llvm::raw_ostream& os, const ReflectionResult& result, const EmitOptions& options) {
+    EmitPreamble(os, result, options);
+    os << '\n';
+    EmitReflections(os, result, options);
+    if (options.registry) {
+        EmitRegistry(os, BuildRegistry(result));
+    }
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <llvm/Support/raw_ostream.h>
+
+#include "reflection_data.h"
+
+// Writers for the generated reflection header. Every piece is written straight into the stream as it is produced,
+// nothing is assembled in intermediate strings or template data trees.
+
+// Options that change the shape of the generated code.
+struct EmitOptions {
+    // Emit constexpr field/method descriptors with counts, indexed field<I>()/method<I>() accessors and
+    // for_each_field()/for_each_method() instead of the std::tuple returned by fields()/methods().
+    bool descriptors = false;
+    // Emit field_index_of()/method_index_of() backed by a generated perfect hash of the member names, and
+    // visit_field()/visit_method() resolving a runtime name to a call with the member's descriptor.
+    bool name_lookup = false;
+    // Emit field offsets, sizes and alignments, type size and alignment, padding holes, triviality flags and the runs
+    // of contiguous trivially copyable fields, all as computed for the target the tool ran for.
+    bool layout = false;
+    // Emit a structure-of-arrays soa_vector<T> next to every reflect<T> whose fields can be stored column by column.
+    bool soa = false;
+    // Emit a binary_serializer<T> for every reflected type, copying contiguous trivially copyable fields in bulk.
+    bool serializer = false;
+    // Emit a streaming json_serializer<T> for every reflected type, dispatching member names through a perfect hash.
+    bool json = false;
+    // Emit the flat runtime type registry: constexpr tables of every known type, field, method and template argument
+    // with a reflect_registry view over them, and the reader for schema files holding the same tables.
+    bool registry = false;
+    // Emit a type-erased thunk per method and an invokers table, indexed like the methods, to call them through.
+    bool invokers = false;
+    // Emit the schema hash of schema_hash.h as a constexpr schema_hash in every reflect<T>.
+    bool schema_hash = false;
+};
+
+void EmitForwardDeclaration(llvm::raw_ostream& os, const TypeData& type_data);
+
+void EmitClassReflection(llvm::raw_ostream& os, const ReflectionData& reflection, const EmitOptions& options);
+
+// Fixed helper templates followed by forward declarations for every inspected type, which can be left out when every
+// reflection comes with the declarations it needs, as the sharded headers do.
+void EmitPreamble(llvm::raw_ostream& os,
+                  const ReflectionResult& result,
+                  const EmitOptions& options,
+                  bool forward_declarations = true);
+
+// One reflect<T> specialization per reflected type and enum.
+void EmitReflections(llvm::raw_ostream& os, const ReflectionResult& result, const EmitOptions& options);
+
+void EmitReflectionFile(llvm::raw_ostream& os, const ReflectionResult& result, const EmitOptions& options);
@@ -0,0 +1,139 @@
+#include "enum_emitter.h"
+
+#include <algorithm>
+#include <llvm/ADT/SmallVector.h>
+
+#include "perfect_hash.h"
+
+void EmitEnumForwardDeclaration(llvm::raw_ostream& os, const EnumData& enum_data) {
+    if (!enum_data.can_forward_declare) {
+        return;
+    }
+    // Namespaces are qualified, the innermost one alone names the whole chain.
+    if (!enum_data.namespaces.empty()) {
+        os << "namespace " << enum_data.namespaces.back() << " {\n";
+    }
+    os << (enum_data.is_scoped ? "enum class " : "enum ") << enum_data.name << " : " << enum_data.underlying_type_name
+       << ";\n";
+    if (!enum_data.namespaces.empty()) {
+        os << "}\n";
+    }
+}
+
+// Compares enumerator values the way the enum's underlying type does.
+static bool ValueLess(const EnumData& enum_data, int64_t a, int64_t b) {
+    return enum_data.is_signed ? a < b : static_cast<uint64_t>(a) < static_cast<uint64_t>(b);
+}
+
+static void EmitToString(llvm::raw_ostream& os, const EnumData& enum_data) {
+    // One enumerator per value, the first declared one for aliases, ordered by value.
+    llvm::SmallVector<EnumeratorData, 16> distinct(enum_data.enumerators.begin(), enum_data.enumerators.end());
+    std::stable_sort(distinct.begin(), distinct.end(), [&](const EnumeratorData& a, const EnumeratorData& b) {
+        return ValueLess(enum_data, a.value, b.value);
+    });
+    distinct.erase(std::unique(distinct.begin(),
+                               distinct.end(),
+                               [](const EnumeratorData& a, const EnumeratorData& b) { return a.value == b.value; }),
+                   distinct.end());
+
+    if (distinct.empty()) {
+        os << "    static constexpr const char * to_string(T) { return nullptr; }\n";
+        return;
+    }
+
+    // Dense when at least half of the table would hold names. Offsets are taken modulo 2^64, which is exact for every
+    // value in range and makes everything below the first value wrap around to a large offset.
+    const auto& first = distinct.front();
+    uint64_t span = static_cast<uint64_t>(distinct.back().value) - static_cast<uint64_t>(first.value);
+    if (span < 2 * distinct.size()) {
+        os << "    static constexpr std::array<const char *, " << span + 1 << "> to_string_table = {{";
+        size_t next = 0;
+        for (uint64_t offset = 0; offset <= span; offset++) {
+            os << (offset == 0 ? " " : ", ");
+            if (static_cast<uint64_t>(distinct[next].value) - static_cast<uint64_t>(first.value) == offset) {
+                os << '"' << distinct[next++].name << '"';
+            } else {
+                os << "nullptr";
+            }
+        }
+        os << " }};\n"
+           << "    static constexpr const char * to_string(T value) {\n"
+           << "        const auto offset = static_cast<std::uint64_t>(static_cast<underlying_type>(value)) -\n"
+           << "                            static_cast<std::uint64_t>(static_cast<underlying_type>(T::" << first.name
+           << "));\n"
+           << "        return offset < to_string_table.size() ? to_string_table[offset] : nullptr;\n"
+           << "    }\n";
+        return;
+    }
+
+    os << "    static constexpr const char * to_string(T value) {\n"
+          "        switch (value) {\n";
+    for (const auto& enumerator : distinct) {
+        os << "            case T::" << enumerator.name << ": return \"" << enumerator.name << "\";\n";
+    }
+    os << "            default: return nullptr;\n"
+          "        }\n"
+          "    }\n";
+}
+
+static void EmitFromString(llvm::raw_ostream& os, const EnumData& enum_data) {
+    const auto& enumerators = enum_data.enumerators;
+    if (enumerators.empty()) {
+        os << "    static constexpr bool from_string(std::string_view, T&) { return false; }\n";
+        return;
+    }
+
+    // Enumerator names are distinct, slots index the enumerators directly.
+    llvm::SmallVector<llvm::StringRef, 16> names;
+    for (const auto& enumerator : enumerators) {
+        names.push_back(enumerator.name);
+    }
+    auto table = BuildPerfectHash(names);
+    os << "    static constexpr std::uint32_t enumerator_hash_seeds[] = {";
+    for (size_t i = 0; i < table.seeds.size(); i++) {
+        os << (i == 0 ? " " : ", ") << table.seeds[i];
+    }
+    os << " };\n";
+    os << "    static constexpr " << (names.size() < 0xffff ? "std::uint16_t" : "std::uint32_t")
+       << " enumerator_hash_slots[] = {";
+    for (size_t i = 0; i < table.slots.size(); i++) {
+        os << (i == 0 ? " " : ", ") << table.slots[i];
+    }
+    os << " };\n";
+
+    os << "    // Stores the enumerator named |name| in |value|, or returns false if there is none.\n"
+       << "    static constexpr bool from_string(std::string_view name, T& value) {\n"
+       << "        const auto seed = enumerator_hash_seeds[reflect_name_hash(name, 0) & " << table.seeds.size() - 1
+       << "];\n"
+       << "        const std::size_t slot = enumerator_hash_slots[reflect_name_hash(name, seed) & "
+       << table.slots.size() - 1 << "];\n"
+       << "        if (slot >= " << names.size() << " || name != enumerator_names[slot]) {\n"
+       << "            return false;\n"
+       << "        }\n"
+       << "        value = enumerators[slot];\n"
+       << "        return true;\n"
+       << "    }\n";
+}
+
+void EmitEnumReflection(llvm::raw_ostream& os, const EnumData& enum_data) {
+    const auto& type_name = enum_data.qualified_type_name;
+    const auto& enumerators = enum_data.enumerators;
+    os << "\ntemplate <typename T> struct reflect<T, typename std::enable_if<std::is_same<T, " << type_name
+       << ">::value, void >::type> {\n";
+    os << "    static constexpr const char * type_name() { return \"" << type_name << "\"; }\n"
+       << "    using underlying_type = " << enum_data.underlying_type_name << ";\n"
+       << "    static constexpr std::size_t enumerator_count = " << enumerators.size() << ";\n";
+    os << "    static constexpr std::array<T, " << enumerators.size() << "> enumerators = {{";
+    for (size_t i = 0; i < enumerators.size(); i++) {
+        os << (i == 0 ? " " : ", ") << "T::" << enumerators[i].name;
+    }
+    os << " }};\n";
+    os << "    static constexpr std::array<const char *, " << enumerators.size() << "> enumerator_names = {{";
+    for (size_t i = 0; i < enumerators.size(); i++) {
+        os << (i == 0 ? " \"" : ", \"") << enumerators[i].name << '"';
+    }
+    os << " }};\n";
+    EmitToString(os, enum_data);
+    EmitFromString(os, enum_data);
+    os << "};\n";
+}
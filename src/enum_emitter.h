@@ -0,0 +1,15 @@
+#pragma once
+
+#include <llvm/Support/raw_ostream.h>
+
+#include "reflection_data.h"
+
+// Writers for the reflect<E> specializations of enums.
+
+// Opaque redeclaration of |enum_data|, only written for enums that allow one.
+void EmitEnumForwardDeclaration(llvm::raw_ostream& os, const EnumData& enum_data);
+
+// reflect<E> with the enumerators and their names in declaration order, to_string() and from_string(). to_string()
+// indexes a table when the enumerator values are dense and switches over them otherwise; from_string() goes through a
+// perfect hash of the names. Both are constexpr and need reflect_name_hash() from the preamble.
+void EmitEnumReflection(llvm::raw_ostream& os, const EnumData& enum_data);
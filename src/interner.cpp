@@ -0,0 +1,106 @@
+#include "interner.h"
+
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <llvm/ADT/DenseSet.h>
+#include <llvm/ADT/Hashing.h>
+#include <llvm/Support/Allocator.h>
+#include <llvm/Support/StringSaver.h>
+#include <mutex>
+#include <thread>
+
+namespace {
+
+// The arena is split into shards with a lock each, so that worker threads interning different spellings rarely wait
+// on one another. A string or list always goes to the shard its contents hash to, which keeps it unique.
+struct Shard {
+    std::mutex mutex;
+    llvm::BumpPtrAllocator allocator;
+    llvm::UniqueStringSaver strings{allocator};
+    llvm::DenseSet<llvm::ArrayRef<llvm::StringRef>> lists;
+};
+
+constexpr size_t shard_count = 16;
+
+} // namespace
+
+static std::array<Shard, shard_count>& TheShards() {
+    static std::array<Shard, shard_count> shards;
+    return shards;
+}
+
+static Shard& ShardFor(size_t hash) {
+    return TheShards()[hash % shard_count];
+}
+
+// Mixes the length with the last eight bytes, where related spellings tend to differ (argument lists, numbered names,
+// pointer and reference suffixes). A full hash here would be paid again by the saver.
+static size_t StringShardHash(llvm::StringRef string) {
+    uint64_t tail = 0;
+    llvm::StringRef bytes = string.take_back(sizeof(tail));
+    std::memcpy(&tail, bytes.data(), bytes.size());
+    return static_cast<size_t>(((tail ^ string.size()) * 0x9e3779b97f4a7c15ull) >> 32);
+}
+
+// The elements are interned, so their addresses identify their contents.
+static size_t ListShardHash(llvm::ArrayRef<llvm::StringRef> strings) {
+    llvm::hash_code hash = llvm::hash_value(strings.size());
+    for (llvm::StringRef string : strings) {
+        hash = llvm::hash_combine(hash, string.data());
+    }
+    return hash;
+}
+
+llvm::StringRef Intern(llvm::StringRef string) {
+    auto& shard = ShardFor(StringShardHash(string));
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    return shard.strings.save(string);
+}
+
+llvm::ArrayRef<llvm::StringRef> Intern(llvm::ArrayRef<llvm::StringRef> strings) {
+    if (strings.empty()) {
+        return {};
+    }
+    auto& shard = ShardFor(ListShardHash(strings));
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    auto it = shard.lists.find(strings);
+    if (it != shard.lists.end()) {
+        return *it;
+    }
+    auto* storage = shard.allocator.Allocate<llvm::StringRef>(strings.size());
+    std::uninitialized_copy(strings.begin(), strings.end(), storage);
+    llvm::ArrayRef<llvm::StringRef> list(storage, strings.size());
+    shard.lists.insert(list);
+    return list;
+}
+
+static thread_local llvm::BumpPtrAllocator* scoped_allocator = nullptr;
+
+ArenaScope::ArenaScope(llvm::BumpPtrAllocator& allocator)
+    : previous_(scoped_allocator) {
+    scoped_allocator = &allocator;
+}
+
+ArenaScope::~ArenaScope() {
+    scoped_allocator = previous_;
+}
+
+void* ArenaAllocate(size_t size, size_t alignment) {
+    if (scoped_allocator) {
+        return scoped_allocator->Allocate(size, llvm::Align(alignment));
+    }
+    // Plain copies are not looked up again, any shard will do; each thread sticks to one.
+    auto& shard = ShardFor(std::hash<std::thread::id>()(std::this_thread::get_id()));
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    return shard.allocator.Allocate(size, llvm::Align(alignment));
+}
+
+size_t ArenaBytes() {
+    size_t bytes = 0;
+    for (auto& shard : TheShards()) {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        bytes += shard.allocator.getTotalMemory();
+    }
+    return bytes;
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <cstddef>
+#include <llvm/ADT/ArrayRef.h>
+#include <llvm/ADT/StringRef.h>
+#include <llvm/Support/Allocator.h>
+#include <memory>
+#include <type_traits>
+
+// Storage behind the reflection metadata. Names and type spellings are interned in a process wide bump arena, so a
+// spelling like "const name::Base &" that thousands of entries share is stored once, and two interned strings are
+// equal exactly when they point to the same bytes. Lists of interned strings (namespace chains, parameter lists) are
+// interned the same way. Interned strings and lists are never freed. All functions are thread safe.
+llvm::StringRef Intern(llvm::StringRef string);
+
+// The elements must already be interned.
+llvm::ArrayRef<llvm::StringRef> Intern(llvm::ArrayRef<llvm::StringRef> strings);
+
+void* ArenaAllocate(size_t size, size_t alignment);
+
+// While alive, ArenaAllocate() on the constructing thread takes memory from |allocator| instead of the process wide
+// arena. Lets the arrays of one source's entries be freed together with them when the source is parsed again.
+class ArenaScope {
+public:
+    explicit ArenaScope(llvm::BumpPtrAllocator& allocator);
+    ~ArenaScope();
+    ArenaScope(const ArenaScope&) = delete;
+    ArenaScope& operator=(const ArenaScope&) = delete;
+
+private:
+    llvm::BumpPtrAllocator* previous_;
+};
+
+// Bytes taken from the system for the process wide arena so far.
+size_t ArenaBytes();
+
+// Copies |values| into the arena without interning, for arrays that belong to a single entry such as the fields of one
+// type. The arena never runs destructors.
+template<typename T>
+llvm::ArrayRef<T> ArenaCopy(llvm::ArrayRef<T> values) {
+    static_assert(std::is_trivially_destructible<T>::value, "arena storage is never destroyed");
+    if (values.empty()) {
+        return {};
+    }
+    auto* storage = static_cast<T*>(ArenaAllocate(values.size() * sizeof(T), alignof(T)));
+    std::uninitialized_copy(values.begin(), values.end(), storage);
+    return llvm::makeArrayRef(storage, values.size());
+}
@@ -0,0 +1,588 @@
+#include "json_emitter.h"
+
+#include <llvm/ADT/SmallVector.h>
+#include <llvm/ADT/StringSet.h>
+
+#include "perfect_hash.h"
+
+static constexpr llvm::StringLiteral json_preamble_helpers = R"(
+// Appends compact JSON to a string. Commas are inserted automatically between members and elements.
+class json_writer {
+public:
+    explicit json_writer(std::string& out)
+        : out_(out) {}
+
+    void begin_object() { open('{'); }
+    void end_object() { close('}'); }
+    void begin_array() { open('['); }
+    void end_array() { close(']'); }
+
+    // |name| is written as is and must not need escaping.
+    void key(const char* name) {
+        separate();
+        out_ += '"';
+        out_ += name;
+        out_ += "\":";
+        need_comma_ = false;
+    }
+
+    void null_value() { scalar("null"); }
+    void value(bool value) { scalar(value ? "true" : "false"); }
+    template<typename N>
+    void number(N value) {
+        char buffer[32];
+        if constexpr (std::is_floating_point<N>::value) {
+            if (!std::isfinite(value)) {
+                null_value();
+                return;
+            }
+#if defined(__cpp_lib_to_chars)
+            // The shortest text that reads back as |value|, whatever the locale.
+            auto result = std::to_chars(buffer, buffer + sizeof(buffer), value);
+            scalar(std::string_view(buffer, static_cast<std::size_t>(result.ptr - buffer)));
+#else
+            // snprintf writes the decimal point of the C locale, JSON always wants '.'.
+            auto length = std::snprintf(buffer,
+                                        sizeof(buffer),
+                                        "%.*g",
+                                        std::numeric_limits<N>::max_digits10,
+                                        static_cast<double>(value));
+            const char point = *std::localeconv()->decimal_point;
+            for (int i = 0; i < length; i++) {
+                if (buffer[i] == point) {
+                    buffer[i] = '.';
+                }
+            }
+            scalar(std::string_view(buffer, static_cast<std::size_t>(length)));
+#endif
+        } else {
+            auto result = std::to_chars(buffer, buffer + sizeof(buffer), value);
+            scalar(std::string_view(buffer, static_cast<std::size_t>(result.ptr - buffer)));
+        }
+    }
+    void string(std::string_view value) {
+        separate();
+        out_ += '"';
+        for (char c : value) {
+            switch (c) {
+                case '"': out_ += "\\\""; break;
+                case '\\': out_ += "\\\\"; break;
+                case '\n': out_ += "\\n"; break;
+                case '\r': out_ += "\\r"; break;
+                case '\t': out_ += "\\t"; break;
+                default:
+                    if (static_cast<unsigned char>(c) < 0x20) {
+                        char escape[8];
+                        std::snprintf(escape, sizeof(escape), "\\u%04x", static_cast<unsigned>(c));
+                        out_ += escape;
+                    } else {
+                        out_ += c;
+                    }
+            }
+        }
+        out_ += '"';
+        need_comma_ = true;
+    }
+
+private:
+    void separate() {
+        if (need_comma_) {
+            out_ += ',';
+        }
+    }
+    void open(char c) {
+        separate();
+        out_ += c;
+        need_comma_ = false;
+    }
+    void close(char c) {
+        out_ += c;
+        need_comma_ = true;
+    }
+    void scalar(std::string_view text) {
+        separate();
+        out_ += text;
+        need_comma_ = true;
+    }
+
+    std::string& out_;
+    bool need_comma_ = false;
+};
+
+// Pull parser over a caller-provided buffer, which has to outlive the reader. Nothing is materialized beyond the values
+// being read; once an error is seen every further call fails.
+class json_reader {
+public:
+    explicit json_reader(std::string_view text)
+        : text_(text) {}
+
+    bool ok() const { return ok_; }
+    std::size_t position() const { return position_; }
+
+    bool begin_object() { return open('{'); }
+    bool begin_array() { return open('['); }
+
+    // Reads the next member name and the colon after it. Returns false after consuming the closing brace, or on error.
+    bool next_key(std::string_view& key) {
+        if (!next('}')) {
+            return false;
+        }
+        if (!raw_string(key) || !expect(':')) {
+            return false;
+        }
+        return true;
+    }
+    // Returns true if another element follows, false after consuming the closing bracket, or on error.
+    bool next_element() { return next(']'); }
+
+    bool read(bool& value) {
+        skip_whitespace();
+        if (text_.substr(position_, 4) == "true") {
+            value = true;
+            position_ += 4;
+            return true;
+        }
+        if (text_.substr(position_, 5) == "false") {
+            value = false;
+            position_ += 5;
+            return true;
+        }
+        return fail();
+    }
+    template<typename N>
+    bool number(N& value) {
+        skip_whitespace();
+        auto start = position_;
+        while (position_ < text_.size() && is_number_char(text_[position_])) {
+            position_++;
+        }
+        auto token = text_.substr(start, position_ - start);
+        if (token.empty()) {
+            return fail();
+        }
+        if constexpr (std::is_floating_point<N>::value) {
+#if defined(__cpp_lib_to_chars)
+            auto result = std::from_chars(token.data(), token.data() + token.size(), value);
+            return (result.ec == std::errc() && result.ptr == token.data() + token.size()) || fail();
+#else
+            // strtod expects the decimal point of the C locale.
+            char buffer[64];
+            if (token.size() >= sizeof(buffer)) {
+                return fail();
+            }
+            token.copy(buffer, token.size());
+            buffer[token.size()] = '\0';
+            const char point = *std::localeconv()->decimal_point;
+            for (std::size_t i = 0; i < token.size(); i++) {
+                if (buffer[i] == '.') {
+                    buffer[i] = point;
+                }
+            }
+            char* end = nullptr;
+            auto parsed = std::strtod(buffer, &end);
+            if (end != buffer + token.size()) {
+                return fail();
+            }
+            value = static_cast<N>(parsed);
+            return true;
+#endif
+        } else {
+            auto result = std::from_chars(token.data(), token.data() + token.size(), value);
+            return (result.ec == std::errc() && result.ptr == token.data() + token.size()) || fail();
+        }
+    }
+    bool string(std::string& value) {
+        std::string_view raw;
+        if (!raw_string(raw)) {
+            return false;
+        }
+        value.clear();
+        value.reserve(raw.size());
+        for (std::size_t i = 0; i < raw.size(); i++) {
+            if (raw[i] != '\\') {
+                value += raw[i];
+                continue;
+            }
+            if (++i == raw.size()) {
+                return fail();
+            }
+            switch (raw[i]) {
+                case 'n': value += '\n'; break;
+                case 'r': value += '\r'; break;
+                case 't': value += '\t'; break;
+                case 'b': value += '\b'; break;
+                case 'f': value += '\f'; break;
+                case 'u': {
+                    unsigned code = 0;
+                    if (!hex_code_unit(raw.substr(i + 1), code) || (code >= 0xdc00 && code < 0xe000)) {
+                        return fail();
+                    }
+                    i += 4;
+                    if (code >= 0xd800 && code < 0xdc00) {
+                        // A high surrogate is only valid followed by an escaped low one.
+                        unsigned low = 0;
+                        if (raw.substr(i + 1, 2) != "\\u" || !hex_code_unit(raw.substr(i + 3), low) || low < 0xdc00 ||
+                            low >= 0xe000) {
+                            return fail();
+                        }
+                        code = 0x10000 + ((code - 0xd800) << 10) + (low - 0xdc00);
+                        i += 6;
+                    }
+                    append_utf8(value, code);
+                    break;
+                }
+                default: value += raw[i];
+            }
+        }
+        return true;
+    }
+
+    // Skips one value of any kind, nested containers included.
+    bool skip_value() {
+        skip_whitespace();
+        if (position_ >= text_.size()) {
+            return fail();
+        }
+        switch (text_[position_]) {
+            case '{': {
+                begin_object();
+                std::string_view key;
+                while (next_key(key)) {
+                    if (!skip_value()) {
+                        return false;
+                    }
+                }
+                return ok_;
+            }
+            case '[': {
+                begin_array();
+                while (next_element()) {
+                    if (!skip_value()) {
+                        return false;
+                    }
+                }
+                return ok_;
+            }
+            case '"': {
+                std::string_view raw;
+                return raw_string(raw);
+            }
+            case 't':
+            case 'f': {
+                bool value;
+                return read(value);
+            }
+            case 'n': return null_value();
+            default: {
+                double value;
+                return number(value);
+            }
+        }
+    }
+    bool null_value() {
+        skip_whitespace();
+        if (text_.substr(position_, 4) == "null") {
+            position_ += 4;
+            return true;
+        }
+        return fail();
+    }
+    // True if the next value is a string.
+    bool at_string() {
+        skip_whitespace();
+        return position_ < text_.size() && text_[position_] == '"';
+    }
+    // The characters between the quotes, escapes left in place. Enough for names, which never need escaping.
+    bool raw_string(std::string_view& raw) {
+        if (!expect('"')) {
+            return false;
+        }
+        auto start = position_;
+        while (position_ < text_.size() && text_[position_] != '"') {
+            position_ += text_[position_] == '\\' ? 2 : 1;
+        }
+        if (position_ >= text_.size()) {
+            return fail();
+        }
+        raw = text_.substr(start, position_ - start);
+        position_++;
+        return true;
+    }
+
+private:
+    bool fail() {
+        ok_ = false;
+        return false;
+    }
+    static bool is_number_char(char c) {
+        return (c >= '0' && c <= '9') || c == '-' || c == '+' || c == '.' || c == 'e' || c == 'E';
+    }
+    void skip_whitespace() {
+        while (position_ < text_.size() &&
+               (text_[position_] == ' ' || text_[position_] == '\n' || text_[position_] == '\r' ||
+                text_[position_] == '\t')) {
+            position_++;
+        }
+    }
+    bool expect(char c) {
+        skip_whitespace();
+        if (!ok_ || position_ >= text_.size() || text_[position_] != c) {
+            return fail();
+        }
+        position_++;
+        return true;
+    }
+    bool open(char c) {
+        first_ = true;
+        return expect(c);
+    }
+    // Shared by objects and arrays: consumes the separator in front of the next entry or the closing |close|.
+    bool next(char close) {
+        skip_whitespace();
+        if (!ok_ || position_ >= text_.size()) {
+            return fail();
+        }
+        if (text_[position_] == close) {
+            position_++;
+            first_ = false;
+            return false;
+        }
+        if (!first_ && !expect(',')) {
+            return false;
+        }
+        first_ = false;
+        return true;
+    }
+    // Reads the four hex digits of a unicode escape from the start of |digits|.
+    static bool hex_code_unit(std::string_view digits, unsigned& code) {
+        digits = digits.substr(0, 4);
+        auto result = std::from_chars(digits.data(), digits.data() + digits.size(), code, 16);
+        return digits.size() == 4 && result.ptr == digits.data() + 4;
+    }
+    static void append_utf8(std::string& out, unsigned code) {
+        if (code < 0x80) {
+            out += static_cast<char>(code);
+        } else if (code < 0x800) {
+            out += static_cast<char>(0xc0 | (code >> 6));
+            out += static_cast<char>(0x80 | (code & 0x3f));
+        } else if (code < 0x10000) {
+            out += static_cast<char>(0xe0 | (code >> 12));
+            out += static_cast<char>(0x80 | ((code >> 6) & 0x3f));
+            out += static_cast<char>(0x80 | (code & 0x3f));
+        } else {
+            out += static_cast<char>(0xf0 | (code >> 18));
+            out += static_cast<char>(0x80 | ((code >> 12) & 0x3f));
+            out += static_cast<char>(0x80 | ((code >> 6) & 0x3f));
+            out += static_cast<char>(0x80 | (code & 0x3f));
+        }
+    }
+
+    std::string_view text_;
+    std::size_t position_ = 0;
+    bool ok_ = true;
+    bool first_ = false; // no separator is expected before the next entry
+};
+
+// Types without a JSON representation. Fields of these types are left out of the objects written and read for their
+// class; every supported type has a specialization below or next to its reflect<T>.
+template<typename T, typename Enable = void>
+struct json_serializer {
+    using unsupported = void;
+};
+
+template<typename T, typename = void>
+struct json_supported : std::true_type {};
+template<typename T>
+struct json_supported<T, typename json_serializer<T>::unsupported> : std::false_type {};
+
+template<>
+struct json_serializer<bool> {
+    static void write(json_writer& writer, bool value) { writer.value(value); }
+    static bool read(json_reader& reader, bool& value) { return reader.read(value); }
+};
+
+template<typename T>
+struct json_serializer<T,
+                       typename std::enable_if<std::is_arithmetic<T>::value && !std::is_same<T, bool>::value>::type> {
+    static void write(json_writer& writer, T value) { writer.number(value); }
+    static bool read(json_reader& reader, T& value) { return reader.number(value); }
+};
+
+template<typename Traits, typename Allocator>
+struct json_serializer<std::basic_string<char, Traits, Allocator>> {
+    static void write(json_writer& writer, const std::basic_string<char, Traits, Allocator>& value) {
+        writer.string(value);
+    }
+    static bool read(json_reader& reader, std::basic_string<char, Traits, Allocator>& value) {
+        return reader.string(value);
+    }
+};
+
+template<typename V, typename Allocator>
+struct json_serializer<std::vector<V, Allocator>, typename std::enable_if<json_supported<V>::value>::type> {
+    static void write(json_writer& writer, const std::vector<V, Allocator>& value) {
+        writer.begin_array();
+        for (const V& element : value) {
+            json_serializer<V>::write(writer, element);
+        }
+        writer.end_array();
+    }
+    static bool read(json_reader& reader, std::vector<V, Allocator>& value) {
+        if (!reader.begin_array()) {
+            return false;
+        }
+        value.clear();
+        while (reader.next_element()) {
+            value.emplace_back();
+            V& element = value.back();
+            if (!json_serializer<V>::read(reader, element)) {
+                return false;
+            }
+        }
+        return reader.ok();
+    }
+};
+
+template<typename T>
+void to_json(const T& value, std::string& out) {
+    json_writer writer(out);
+    json_serializer<T>::write(writer, value);
+}
+
+// Returns false unless |text| starts with a well formed JSON value matching T.
+template<typename T>
+bool from_json(std::string_view text, T& value) {
+    json_reader reader(text);
+    return json_serializer<T>::read(reader, value);
+}
+)";
+
+void EmitJsonPreamble(llvm::raw_ostream& os) {
+    os << json_preamble_helpers;
+}
+
+void EmitJsonSerializer(llvm::raw_ostream& os, const ReflectionData& reflection) {
+    // Members of anonymous structs and unions and unnamed bit-fields have no key, and a name is written only once.
+    llvm::SmallVector<const FieldData*, 16> fields;
+    llvm::StringSet<> seen;
+    for (const auto& field : reflection.fields) {
+        if (!field.name.empty() && seen.insert(field.name).second) {
+            fields.push_back(&field);
+        }
+    }
+    os << "\ntemplate <typename T> struct json_serializer<T, typename std::enable_if<std::is_same<T, "
+       << reflection.qualified_type_name << ">::value, void >::type> {\n";
+
+    os << "    static void write(json_writer& writer, const T& value) {\n"
+          "        writer.begin_object();\n";
+    for (const auto* field : fields) {
+        os << "        if constexpr (json_supported<decltype(T::" << field->name << ")>::value) {\n"
+           << "            writer.key(\"" << field->name << "\");\n"
+           << "            json_serializer<decltype(T::" << field->name << ")>::write(writer, value." << field->name
+           << ");\n"
+           << "        }\n";
+    }
+    if (fields.empty()) {
+        os << "        (void)value;\n";
+    }
+    os << "        writer.end_object();\n"
+          "    }\n";
+
+    os << "    static bool read(json_reader& reader, T& value) {\n"
+          "        if (!reader.begin_object()) {\n"
+          "            return false;\n"
+          "        }\n"
+          "        std::string_view key;\n"
+          "        while (reader.next_key(key)) {\n";
+    if (fields.empty()) {
+        os << "            if (!reader.skip_value()) {\n"
+              "                return false;\n"
+              "            }\n"
+              "        }\n"
+              "        (void)value;\n"
+              "        return reader.ok();\n"
+              "    }\n"
+              "};\n";
+        return;
+    }
+
+    llvm::SmallVector<llvm::StringRef, 16> names;
+    for (const auto* field : fields) {
+        names.push_back(field->name);
+    }
+    auto table = BuildPerfectHash(names);
+    os << "            static constexpr std::uint32_t seeds[] = {";
+    for (size_t i = 0; i < table.seeds.size(); i++) {
+        os << (i == 0 ? " " : ", ") << table.seeds[i];
+    }
+    os << " };\n"
+       << "            const auto seed = seeds[reflect_name_hash(key, 0) & " << table.seeds.size() - 1 << "];\n"
+       << "            bool known = false;\n"
+       << "            switch (reflect_name_hash(key, seed) & " << table.slots.size() - 1 << ") {\n";
+    for (size_t slot = 0; slot < table.slots.size(); slot++) {
+        if (table.slots[slot] == fields.size()) {
+            continue;
+        }
+        const auto& name = fields[table.slots[slot]]->name;
+        // Keys of fields without a serializer are skipped like unknown ones.
+        os << "                case " << slot << ":\n"
+           << "                    if constexpr (json_supported<decltype(T::" << name << ")>::value) {\n"
+           << "                        if (key == \"" << name << "\") {\n";
+        if (fields[table.slots[slot]]->is_const) {
+            // Written like any field, but there is nothing to assign the value to.
+            os << "                            if (!reader.skip_value()) {\n"
+               << "                                return false;\n"
+               << "                            }\n";
+        } else if (fields[table.slots[slot]]->is_bitfield) {
+            os << "                            decltype(T::" << name << ") field{};\n"
+               << "                            if (!json_serializer<decltype(T::" << name
+               << ")>::read(reader, field)) {\n"
+               << "                                return false;\n"
+               << "                            }\n"
+               << "                            value." << name << " = field;\n";
+        } else {
+            os << "                            if (!json_serializer<decltype(T::" << name
+               << ")>::read(reader, value." << name << ")) {\n"
+               << "                                return false;\n"
+               << "                            }\n";
+        }
+        os << "                            known = true;\n"
+              "                        }\n"
+              "                    }\n"
+              "                    break;\n";
+    }
+    os << "                default: break;\n"
+          "            }\n"
+          "            if (!known && !reader.skip_value()) {\n"
+          "                return false;\n"
+          "            }\n"
+          "        }\n"
+          "        return reader.ok();\n"
+          "    }\n"
+          "};\n";
+}
+
+void EmitJsonEnumSerializer(llvm::raw_ostream& os, const EnumData& enum_data) {
+    os << "\ntemplate <typename T> struct json_serializer<T, typename std::enable_if<std::is_same<T, "
+       << enum_data.qualified_type_name << ">::value, void >::type> {\n"
+       << "    static void write(json_writer& writer, T value) {\n"
+       << "        if (const char* name = reflect<T>::to_string(value)) {\n"
+       << "            writer.string(name);\n"
+       << "        } else {\n"
+       << "            writer.number(static_cast<typename reflect<T>::underlying_type>(value));\n"
+       << "        }\n"
+       << "    }\n"
+       << "    static bool read(json_reader& reader, T& value) {\n"
+       << "        if (!reader.at_string()) {\n"
+       << "            typename reflect<T>::underlying_type number{};\n"
+       << "            if (!reader.number(number)) {\n"
+       << "                return false;\n"
+       << "            }\n"
+       << "            value = static_cast<T>(number);\n"
+       << "            return true;\n"
+       << "        }\n"
+       << "        std::string_view name;\n"
+       << "        return reader.raw_string(name) && reflect<T>::from_string(name, value);\n"
+       << "    }\n"
+       << "};\n";
+}
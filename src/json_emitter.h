@@ -0,0 +1,20 @@
+#pragma once
+
+#include <llvm/Support/raw_ostream.h>
+
+#include "reflection_data.h"
+
+// Writers for the streaming JSON support generated with --json.
+
+// json_writer/json_reader and the json_serializer specializations for fundamental types, strings and vectors of
+// supported elements, plus the to_json()/from_json() entry points. Expects reflect_name_hash() to be defined before it.
+void EmitJsonPreamble(llvm::raw_ostream& os);
+
+// json_serializer<T> for |reflection|, writing an object with one member per field. Reading dispatches keys through a
+// perfect hash of the field names, skips unknown keys and stores every value directly into its field. Fields whose
+// type has no json_serializer are neither written nor read.
+void EmitJsonSerializer(llvm::raw_ostream& os, const ReflectionData& reflection);
+
+// json_serializer<E> for |enum_data|, writing enumerators by name through reflect<E>::to_string() and values without
+// a name as numbers. Reading accepts both.
+void EmitJsonEnumSerializer(llvm::raw_ostream& os, const EnumData& enum_data);
@@ -0,0 +1,77 @@
+#include "layout.h"
+
+#include <algorithm>
+
+std::vector<LayoutRange> ComputePaddingHoles(const ReflectionData& reflection) {
+    std::vector<LayoutRange> holes;
+    if (!reflection.has_layout) {
+        return holes;
+    }
+    bool known_end = false; // false while the end of the previous field is unknown
+    uint64_t end = 0;
+    for (const auto& field : reflection.fields) {
+        if (field.is_bitfield) {
+            known_end = false;
+            continue;
+        }
+        auto offset = field.offset_bits / 8;
+        if (known_end && offset > end) {
+            holes.push_back({end, offset - end});
+        }
+        // Empty fields may share their address with their neighbours, never move the end backwards.
+        end = std::max(known_end ? end : 0, offset + field.size);
+        known_end = true;
+    }
+    if (known_end && reflection.size > end) {
+        holes.push_back({end, reflection.size - end});
+    }
+    if (reflection.opaque_ranges.empty()) {
+        return holes;
+    }
+    // Both lists are ordered by offset; opaque ranges may overlap one another.
+    std::vector<LayoutRange> padding;
+    for (const auto& hole : holes) {
+        uint64_t begin = hole.offset;
+        uint64_t hole_end = hole.offset + hole.size;
+        for (const auto& range : reflection.opaque_ranges) {
+            if (begin >= hole_end || range.offset >= hole_end) {
+                break;
+            }
+            if (range.offset + range.size <= begin) {
+                continue;
+            }
+            if (range.offset > begin) {
+                padding.push_back({begin, range.offset - begin});
+            }
+            begin = range.offset + range.size;
+        }
+        if (begin < hole_end) {
+            padding.push_back({begin, hole_end - begin});
+        }
+    }
+    return padding;
+}
+
+std::vector<CopyRun> ComputeCopyRuns(const ReflectionData& reflection) {
+    std::vector<CopyRun> runs;
+    if (!reflection.has_layout) {
+        return runs;
+    }
+    bool in_run = false;
+    for (size_t i = 0; i < reflection.fields.size(); i++) {
+        const auto& field = reflection.fields[i];
+        if (field.is_bitfield || !field.is_trivially_copyable || field.size == 0) {
+            in_run = false;
+            continue;
+        }
+        auto offset = field.offset_bits / 8;
+        if (in_run && runs.back().offset + runs.back().size == offset) {
+            runs.back().size += field.size;
+            runs.back().field_count++;
+            continue;
+        }
+        runs.push_back({offset, field.size, i, 1});
+        in_run = true;
+    }
+    return runs;
+}
@@ -0,0 +1,23 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "reflection_data.h"
+
+// Fields [first_field, first_field + field_count) are trivially copyable and follow each other without padding, so
+// the bytes [offset, offset + size) can be copied with a single memcpy.
+struct CopyRun {
+    uint64_t offset = 0;
+    uint64_t size = 0;
+    size_t first_field = 0;
+    size_t field_count = 0;
+};
+
+// Padding between consecutive fields and at the end of the object, minus the type's opaque ranges. Storage in front of
+// the first field belongs to a vtable pointer or to bases whose fields are not reflected and is not reported, neither
+// are gaps next to bit-fields.
+std::vector<LayoutRange> ComputePaddingHoles(const ReflectionData& reflection);
+
+// Maximal runs of contiguous trivially copyable fields in declaration order; bit-fields never belong to a run.
+std::vector<CopyRun> ComputeCopyRuns(const ReflectionData& reflection);
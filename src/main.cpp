@@ -1,55 +1,64 @@
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <numeric>
+#include <optional>
+#include <set>
+#include <clang/AST/CXXInheritance.h>
+#include <clang/AST/RecordLayout.h>
 #include <clang/AST/Type.h>
 #include <clang/ASTMatchers/ASTMatchFinder.h>
 #include <clang/ASTMatchers/ASTMatchers.h>
+#include <clang/Frontend/CompilerInstance.h>
+#include <clang/Frontend/FrontendActions.h>
 #include <clang/Tooling/CommonOptionsParser.h>
 #include <clang/Tooling/Tooling.h>
-#include <iostream>
+#include <llvm/ADT/DenseMap.h>
+#include <llvm/ADT/DenseSet.h>
+#include <llvm/ADT/STLExtras.h>
+#include <llvm/ADT/ScopeExit.h>
+#include <llvm/ADT/StringExtras.h>
+#include <llvm/Support/ThreadPool.h>
+#include <llvm/Support/TimeProfiler.h>
+#include <llvm/Support/ToolOutputFile.h>
+#include <llvm/Support/VirtualFileSystem.h>
 
-#include "mustache.hpp"
+#include "cache.h"
+#include "emitter.h"
+#include "interner.h"
+#include "output.h"
+#include "reflection_data.h"
+#include "registry.h"
+#include "schema_hash.h"
+#include "server.h"
+#include "stats.h"
 
 constexpr auto reflection_name = "reflect";
 constexpr auto bind_name = "reflection";
 
-struct TemplateParamData {
-    bool is_type = true;
-    std::string name;
-    std::string non_type_type_name;
-    std::string non_type_value;
-    std::string instantiated_type_name;
-};
-struct TypeData {
-    const clang::Type* type_ptr = nullptr;
-    std::string name;
-    std::string qualified_name;
-    std::vector<std::string> namespaces;
-    bool is_templated = false;
-    std::vector<TemplateParamData> template_params;
-};
-std::map<const clang::Type*, TypeData> g_type_infos; // needed for forward declarations
-
-struct FieldData {
-    std::string name;
-    std::string qualified_name;
-    std::string qualified_type_name;
-    const clang::Type* type_ptr = nullptr;
-};
-struct MethodData {
-    std::string name;
-    std::string qualified_name;
-    std::string qualified_return_type_name;
-    std::string method_qualified_type_name;
-    std::vector<std::string> param_type_list;
-    const clang::Type* return_type_ptr = nullptr;
-    std::vector<const clang::Type*> param_type_ptrs;
-};
-struct ReflectionData {
-    std::string qualified_type_name;
-    std::vector<FieldData> fields;
-    std::vector<MethodData> methods;
-    const clang::Type* type_ptr;
+// Tables filled while a single translation unit is being matched. The keys point into that TU's ASTContext and are
+// only meaningful until it is torn down, so the tables are folded into a ReflectionResult at the end of each TU.
+// Types are interned by canonical type and reflections by canonical record or enum declaration, so a type reached
+// through typedefs, aliases or differently sugared template arguments is inspected and stored once.
+struct ReflectionTables {
+    llvm::DenseSet<const clang::Type*> inspected_types;
+    llvm::DenseMap<const clang::Type*, TypeData> type_infos; // needed for forward declarations
+    llvm::DenseMap<const clang::RecordDecl*, ReflectionData> reflection_table;
+    llvm::DenseMap<const clang::EnumDecl*, EnumData> enum_table;
+    uint64_t type_cache_hits = 0; // InspectType calls for a type already in inspected_types
 };
 
-std::map<const clang::Type*, ReflectionData> g_reflection_table;
+void MergeReflectionTables(const ReflectionTables& tables, ReflectionResult& result) {
+    for (const auto& [type_ptr, type_data] : tables.type_infos) {
+        result.type_infos.try_emplace(type_data.qualified_name, type_data);
+    }
+    for (const auto& [type_ptr, reflection] : tables.reflection_table) {
+        result.reflection_table.try_emplace(reflection.qualified_type_name, reflection);
+    }
+    for (const auto& [enum_decl, enum_data] : tables.enum_table) {
+        result.enum_table.try_emplace(enum_data.qualified_type_name, enum_data);
+    }
+}
 
 using MatchFinder = clang::ast_matchers::MatchFinder;
 using MatchCallback = clang::ast_matchers::MatchFinder::MatchCallback;
@@ -66,23 +75,84 @@ template<typename T>
 struct is_class_decl<T, std::void_t<decltype(std::declval<T>().fields()), decltype(std::declval<T>().methods())>>
     : std::true_type {};
 
-auto InspectType(clang::QualType qual_type, const clang::ASTContext& ast_ctx) {
+// Spelling used to key types everywhere, matching TypeData::qualified_name.
+static llvm::StringRef CanonicalTypeName(clang::QualType qual_type, const clang::ASTContext& ast_ctx) {
+    return Intern(qual_type.getCanonicalType().getUnqualifiedType().getAsString(ast_ctx.getPrintingPolicy()));
+}
+
+// Appends what FieldData::stored_type_names lists for a field of type |qual_type|. Pointers and references do not store
+// what they point to and end the walk.
+static void CollectStoredTypeNames(clang::QualType qual_type,
+                                   const clang::ASTContext& ast_ctx,
+                                   llvm::SmallVectorImpl<llvm::StringRef>& names) {
+    while (const auto* array = ast_ctx.getAsArrayType(qual_type)) {
+        qual_type = array->getElementType();
+    }
+    const auto* record = qual_type->getAsCXXRecordDecl();
+    if (!record) {
+        return;
+    }
+    auto name = CanonicalTypeName(qual_type, ast_ctx);
+    if (llvm::is_contained(names, name)) {
+        return;
+    }
+    names.push_back(name);
+    const auto* specialization = clang::dyn_cast<clang::ClassTemplateSpecializationDecl>(record);
+    if (!specialization) {
+        return;
+    }
+    auto collect = [&](const clang::TemplateArgument& arg) {
+        if (arg.getKind() == clang::TemplateArgument::Type) {
+            CollectStoredTypeNames(arg.getAsType(), ast_ctx, names);
+        }
+    };
+    for (const auto& arg : specialization->getTemplateArgs().asArray()) {
+        if (arg.getKind() == clang::TemplateArgument::Pack) {
+            for (const auto& element : arg.pack_elements()) {
+                collect(element);
+            }
+        } else {
+            collect(arg);
+        }
+    }
+}
+
+// Interned spelling of |qual_type| as written, sugar included.
+static llvm::StringRef TypeSpelling(clang::QualType qual_type, const clang::ASTContext& ast_ctx) {
+    return Intern(qual_type.getAsString(ast_ctx.getPrintingPolicy()));
+}
+
+// Qualified names of the namespaces |decl| is declared in, outermost first.
+static llvm::ArrayRef<llvm::StringRef> EnclosingNamespaces(const clang::Decl* decl) {
+    llvm::SmallVector<llvm::StringRef, 4> namespaces;
+    auto decl_ctx = decl->getDeclContext();
+    while (decl_ctx) {
+        if (decl_ctx->isNamespace()) {
+            auto namespace_decl = clang::dyn_cast<clang::NamespaceDecl>(decl_ctx);
+            namespaces.insert(namespaces.begin(), Intern(namespace_decl->getQualifiedNameAsString()));
+        }
+        decl_ctx = decl_ctx->getParent();
+    }
+    return Intern(namespaces);
+}
+
+auto InspectType(clang::QualType qual_type, const clang::ASTContext& ast_ctx, ReflectionTables& tables) {
+    qual_type = qual_type.getCanonicalType().getUnqualifiedType();
     auto type_ptr = qual_type.getTypePtrOrNull();
-    if (g_type_infos.find(type_ptr) != g_type_infos.end()) {
+    if (!tables.inspected_types.insert(type_ptr).second) {
+        tables.type_cache_hits++;
+        return type_ptr;
+    }
+    auto record_type = qual_type->getAs<clang::RecordType>();
+    if (!record_type) {
         return type_ptr;
     }
     TypeData result;
     result.type_ptr = type_ptr;
     auto policy = ast_ctx.getPrintingPolicy();
     // policy.SuppressScope = 1;
-    result.qualified_name = qual_type.getAsString(policy);
-    if (!qual_type->getAs<clang::RecordType>()) {
-        return type_ptr;
-    }
-    auto decl = qual_type->getAs<clang::RecordType>()->getDecl();
-    if (auto canonical_record_type = qual_type.getCanonicalType()->getAs<clang::RecordType>()) {
-        decl = canonical_record_type->getDecl();
-    }
+    result.qualified_name = Intern(qual_type.getAsString(policy));
+    auto decl = record_type->getDecl();
     if (decl) {
         if (auto class_templ_spec_decl = llvm::dyn_cast<clang::ClassTemplateSpecializationDecl>(decl)) {
             result.is_templated = true;
@@ -90,54 +160,218 @@ auto InspectType(clang::QualType qual_type, const clang::ASTContext& ast_ctx) {
             auto param_list = templ_decl->getDescribedTemplateParams();
 
             int i = 0;
+            llvm::SmallVector<TemplateParamData, 4> template_params;
             for (const auto& arg : class_templ_spec_decl->getTemplateArgs().asArray()) {
                 TemplateParamData template_param;
-                template_param.name = "arg" + std::to_string(i);
+                template_param.name = Intern("arg" + std::to_string(i));
                 // arg.dump();
                 if (arg.getKind() == clang::TemplateArgument::ArgKind::Type) {
                     template_param.is_type = true;
-                    template_param.instantiated_type_name = arg.getAsType().getAsString(ast_ctx.getPrintingPolicy());
-                    InspectType(arg.getAsType(), ast_ctx);
+                    template_param.instantiated_type_name = TypeSpelling(arg.getAsType(), ast_ctx);
+                    template_param.canonical_type_name = CanonicalTypeName(arg.getAsType(), ast_ctx);
+                    InspectType(arg.getAsType(), ast_ctx, tables);
                 } else {
                     template_param.is_type = false;
-                    template_param.non_type_type_name =
-                        arg.getNonTypeTemplateArgumentType().getAsString(ast_ctx.getPrintingPolicy());
-                    InspectType(arg.getNonTypeTemplateArgumentType(), ast_ctx);
+                    template_param.non_type_type_name = TypeSpelling(arg.getNonTypeTemplateArgumentType(), ast_ctx);
+                    template_param.canonical_type_name =
+                        CanonicalTypeName(arg.getNonTypeTemplateArgumentType(), ast_ctx);
+                    InspectType(arg.getNonTypeTemplateArgumentType(), ast_ctx, tables);
                     // TODO: handle non integral kind
                     if (arg.getKind() == clang::TemplateArgument::Integral) {
-                        template_param.non_type_value = std::to_string(arg.getAsIntegral().getExtValue());
+                        template_param.non_type_value = Intern(std::to_string(arg.getAsIntegral().getExtValue()));
                     }
                 }
                 i++;
-                result.template_params.emplace_back(template_param);
-            }
-        }
-        result.name = decl->getNameAsString();
-        auto decl_ctx = decl->getDeclContext();
-        while (decl_ctx) {
-            if (decl_ctx->isNamespace()) {
-                auto namespace_decl = clang::dyn_cast<clang::NamespaceDecl>(decl_ctx);
-                result.namespaces.insert(result.namespaces.begin(), namespace_decl->getQualifiedNameAsString());
+                template_params.emplace_back(template_param);
             }
-            decl_ctx = decl_ctx->getParent();
+            result.template_params = ArenaCopy(llvm::makeArrayRef(template_params));
         }
+        result.name = Intern(decl->getNameAsString());
+        result.namespaces = EnclosingNamespaces(decl);
     }
-    g_type_infos.insert({type_ptr, result});
+    tables.type_infos.try_emplace(type_ptr, result);
     return type_ptr;
 }
 
+// A base whose fields are part of the flattened field list, with its layout and its offset within the reflected type.
+// The layout is only known when the reflected type's is.
+struct FlattenedBase {
+    const clang::CXXRecordDecl* decl = nullptr;
+    const clang::ASTRecordLayout* layout = nullptr;
+    uint64_t offset_bits = 0;
+};
+
+// Appends the public non-virtual bases of |record| at any depth, every base after its own bases, ordered by their
+// position when the layout is known. Members of virtual bases are left out: a pointer to one of them cannot be
+// converted to a pointer to member of the derived type.
+static void CollectFlattenedBases(const clang::CXXRecordDecl* record,
+                                  const clang::ASTRecordLayout* layout,
+                                  uint64_t offset_bits,
+                                  const clang::ASTContext& ctx,
+                                  llvm::SmallVectorImpl<FlattenedBase>& bases) {
+    size_t first = bases.size();
+    for (const auto& base : record->bases()) {
+        auto base_decl = base.getType()->getAsCXXRecordDecl();
+        if (base.isVirtual() || base.getAccessSpecifier() != clang::AS_public || !base_decl ||
+            !base_decl->hasDefinition()) {
+            continue;
+        }
+        base_decl = base_decl->getDefinition();
+        FlattenedBase flattened{base_decl, nullptr, 0};
+        if (layout) {
+            flattened.layout = &ctx.getASTRecordLayout(base_decl);
+            flattened.offset_bits = offset_bits + ctx.toBits(layout->getBaseClassOffset(base_decl));
+        }
+        CollectFlattenedBases(base_decl, flattened.layout, flattened.offset_bits, ctx, bases);
+        bases.push_back(flattened);
+    }
+    if (layout) {
+        std::stable_sort(bases.begin() + first, bases.end(), [](const FlattenedBase& a, const FlattenedBase& b) {
+            return a.offset_bits < b.offset_bits;
+        });
+    }
+}
+
+// Bytes taken by |field|, declared in a record laid out by |layout| that starts |offset_bits| into the reflected type.
+static LayoutRange FieldRange(const clang::FieldDecl* field,
+                              const clang::ASTRecordLayout& layout,
+                              uint64_t offset_bits,
+                              const clang::ASTContext& ctx) {
+    uint64_t begin_bits = offset_bits + layout.getFieldOffset(field->getFieldIndex());
+    uint64_t end_bits =
+        begin_bits + (field->isBitField() ? field->getBitWidthValue(ctx) : ctx.getTypeSize(field->getType()));
+    return {begin_bits / 8, (end_bits + 7) / 8 - begin_bits / 8};
+}
+
+// Appends what |record|, laid out by |layout| |offset_bits| into the reflected type, holds besides fields: its own
+// vtable pointers and its non-virtual bases that are not flattened.
+static void AddOpaqueBaseRanges(const clang::CXXRecordDecl* record,
+                                const clang::ASTRecordLayout& layout,
+                                uint64_t offset_bits,
+                                const clang::ASTContext& ctx,
+                                llvm::SmallVectorImpl<LayoutRange>& ranges) {
+    uint64_t offset = offset_bits / 8;
+    uint64_t pointer_size = ctx.getTypeSizeInChars(ctx.VoidPtrTy).getQuantity();
+    if (layout.hasOwnVFPtr()) {
+        ranges.push_back({offset, pointer_size});
+    }
+    if (layout.hasOwnVBPtr()) {
+        ranges.push_back({offset + layout.getVBPtrOffset().getQuantity(), pointer_size});
+    }
+    for (const auto& base : record->bases()) {
+        auto base_decl = base.getType()->getAsCXXRecordDecl();
+        if (base.isVirtual() || base.getAccessSpecifier() == clang::AS_public || !base_decl ||
+            !base_decl->hasDefinition()) {
+            continue;
+        }
+        base_decl = base_decl->getDefinition();
+        ranges.push_back({offset + layout.getBaseClassOffset(base_decl).getQuantity(),
+                          static_cast<uint64_t>(ctx.getASTRecordLayout(base_decl).getNonVirtualSize().getQuantity())});
+    }
+}
+
+// Whether |record|.|field| names |field|, an inherited field: the name must not be declared in |record| itself, and
+// looking it up in the bases must stop at |field|'s class on a single path, which rules out both hiding (a class on
+// the way declares the name too) and ambiguity (the name is found in several base subobjects).
+static bool NamesInheritedField(const clang::CXXRecordDecl* record, const clang::FieldDecl* field) {
+    auto name = field->getDeclName();
+    if (!record->lookup(name).empty()) {
+        return false;
+    }
+    clang::CXXBasePaths paths(/*FindAmbiguities=*/true, /*RecordPaths=*/true, /*DetectVirtual=*/false);
+    bool found = record->lookupInBases(
+        [&](const clang::CXXBaseSpecifier* specifier, clang::CXXBasePath&) {
+            auto base_decl = specifier->getType()->getAsCXXRecordDecl();
+            return base_decl && base_decl->hasDefinition() && !base_decl->getDefinition()->lookup(name).empty();
+        },
+        paths);
+    if (!found || std::distance(paths.begin(), paths.end()) != 1) {
+        return false;
+    }
+    auto found_decl = paths.front().back().Base->getType()->getAsCXXRecordDecl();
+    return found_decl && found_decl->getCanonicalDecl() == field->getParent()->getCanonicalDecl();
+}
+
 template<typename T>
 std::enable_if_t<is_class_decl<T>::value, void>
-ReflectImpl(const T* class_decl, const clang::ASTContext& ctx, ReflectionData& reflection) {
-    for (const clang::FieldDecl* field : class_decl->fields()) {
+ReflectImpl(const T* class_decl, const clang::ASTContext& ctx, ReflectionData& reflection, ReflectionTables& tables) {
+    const clang::ASTRecordLayout* layout = nullptr;
+    if (class_decl->isCompleteDefinition() && !class_decl->isDependentType() && !class_decl->isInvalidDecl()) {
+        layout = &ctx.getASTRecordLayout(class_decl);
+        reflection.has_layout = true;
+        reflection.size = layout->getSize().getQuantity();
+        reflection.alignment = layout->getAlignment().getQuantity();
+        reflection.is_trivially_copyable = class_decl->isTriviallyCopyable();
+        reflection.is_standard_layout = class_decl->isStandardLayout();
+    }
+    // Built here and copied into the arena once complete.
+    llvm::SmallVector<FieldData, 16> fields;
+    llvm::SmallVector<MethodData, 16> methods;
+    // |field_layout| belongs to the record declaring |field|, which starts |base_offset_bits| into the reflected one.
+    auto add_field = [&](const clang::FieldDecl* field,
+                         const clang::ASTRecordLayout* field_layout,
+                         uint64_t base_offset_bits) {
         FieldData field_data;
-        field_data.name = field->getNameAsString();
-        field_data.qualified_name = field->getQualifiedNameAsString();
-        field_data.qualified_type_name = field->getType().getAsString(ctx.getPrintingPolicy());
-        InspectType(field->getType(), ctx);
-        reflection.fields.emplace_back(field_data);
+        field_data.name = Intern(field->getNameAsString());
+        field_data.qualified_name = Intern(field->getQualifiedNameAsString());
+        field_data.qualified_type_name = TypeSpelling(field->getType(), ctx);
+        field_data.canonical_type_name = CanonicalTypeName(field->getType(), ctx);
+        llvm::SmallVector<llvm::StringRef, 4> stored_type_names;
+        CollectStoredTypeNames(field->getType(), ctx, stored_type_names);
+        field_data.stored_type_names = Intern(stored_type_names);
+        field_data.is_const = field->getType().isConstQualified();
+        field_data.is_reference = field->getType()->isReferenceType();
+        field_data.is_array = field->getType()->isArrayType();
+        if (field_layout) {
+            field_data.offset_bits = base_offset_bits + field_layout->getFieldOffset(field->getFieldIndex());
+            field_data.is_bitfield = field->isBitField();
+            if (field_data.is_bitfield) {
+                field_data.bit_width = field->getBitWidthValue(ctx);
+            } else {
+                // References report the size of their storage here, not of the referenced type.
+                auto type_info = ctx.getTypeInfoInChars(field->getType());
+                field_data.size = type_info.Width.getQuantity();
+                field_data.alignment = type_info.Align.getQuantity();
+            }
+            field_data.is_trivially_copyable = field->getType().isTriviallyCopyableType(ctx);
+        }
+        InspectType(field->getType(), ctx, tables);
+        fields.emplace_back(field_data);
+    };
+    // Storage that is neither a reflected field nor padding, so that layout reports do not take it for holes.
+    llvm::SmallVector<LayoutRange, 4> opaque_ranges;
+    if (layout) {
+        AddOpaqueBaseRanges(class_decl, *layout, 0, ctx, opaque_ranges);
+        for (const auto& base : class_decl->vbases()) {
+            auto base_decl = base.getType()->getAsCXXRecordDecl();
+            opaque_ranges.push_back(
+                {static_cast<uint64_t>(layout->getVBaseClassOffset(base_decl).getQuantity()),
+                 static_cast<uint64_t>(ctx.getASTRecordLayout(base_decl).getNonVirtualSize().getQuantity())});
+        }
+    }
+    if (class_decl->hasDefinition()) {
+        // Inherited fields are emitted as T::name too, so only those that name reaches are kept.
+        llvm::SmallVector<FlattenedBase, 4> bases;
+        CollectFlattenedBases(class_decl, layout, 0, ctx, bases);
+        for (const auto& base : bases) {
+            if (layout) {
+                AddOpaqueBaseRanges(base.decl, *base.layout, base.offset_bits, ctx, opaque_ranges);
+            }
+            for (const clang::FieldDecl* field : base.decl->fields()) {
+                if (field->getAccess() != clang::AS_public || !field->getIdentifier() ||
+                    !NamesInheritedField(class_decl, field)) {
+                    if (layout) {
+                        opaque_ranges.push_back(FieldRange(field, *base.layout, base.offset_bits, ctx));
+                    }
+                    continue;
+                }
+                add_field(field, base.layout, base.offset_bits);
+            }
+        }
+    }
+    for (const clang::FieldDecl* field : class_decl->fields()) {
+        add_field(field, layout, 0);
     }
-    namespace mstch = kainjow::mustache;
     for (const clang::CXXMethodDecl* method : class_decl->methods()) {
         if (method->getKind() == clang::CXXMethodDecl::Kind::CXXConstructor) {
             continue;
@@ -146,183 +380,90 @@ ReflectImpl(const T* class_decl, const clang::ASTContext& ctx, ReflectionData& r
             continue;
         }
         MethodData method_data;
-        method_data.name = method->getNameAsString();
-        method_data.qualified_name = method->getQualifiedNameAsString();
-        method_data.qualified_return_type_name = method->getReturnType().getAsString(ctx.getPrintingPolicy());
-        InspectType(method->getReturnType(), ctx);
-        mstch::mustache method_qualified_type_template{
-            R"({{return_type}} ({{class_name}}::*)({{#params}}{{{param_type_name}}}{{delimiter}}{{/params}}))"};
-        mstch::data method_qualified_type_data{mstch::data::type::object};
-        method_qualified_type_data.set("return_type", method_data.qualified_return_type_name);
-        method_qualified_type_data.set("class_name", "T");
-
-        mstch::data params{mstch::data::type::list};
-        for (size_t i = 0; i < method->param_size(); i++) {
-            auto param = method->getParamDecl(i);
-            auto param_type = param->getType().getAsString(ctx.getPrintingPolicy());
-
-            mstch::data param_data{mstch::data::type::object};
-            method_data.param_type_list.emplace_back(param_type);
-            param_data.set("param_type_name", param_type);
-            param_data.set("delimiter", i == method->param_size() - 1 ? "" : ", ");
-            params << param_data;
-            InspectType(param->getType(), ctx);
-        }
-        method_qualified_type_data.set("params", params);
-        method_data.method_qualified_type_name = method_qualified_type_template.render(method_qualified_type_data);
-        reflection.methods.emplace_back(method_data);
-    }
-}
-
-std::string GenerateClassReflectionCode(const ReflectionData& reflection) {
-    namespace mstch = kainjow::mustache;
-
-    mstch::mustache reflection_template{R"(
-template <typename T> struct reflect<T, typename std::enable_if<std::is_same<T, {{{type_name}}}>::value, void >::type> {
-    static constexpr const char * type_name() { return "{{{type_name}}}"; }
-    static constexpr auto fields() {
-        return std::make_tuple(
-            {{#field_member_infos}}
-                member_info<T, decltype(T::{{field_name}})>{ "{{field_name}}", &T::{{field_name}} } {{{delimiter}}}
-            {{/field_member_infos}}
-        );
-    }
-    static constexpr auto methods() {
-        return std::make_tuple(
-            {{#method_member_infos}}
-                method_info<T, decltype(&T::{{method_name}})>{ "{{method_name}}", &T::{{method_name}} } {{{delimiter}}}
-            {{/method_member_infos}}
-        );
-    }
-};
-    )"};
-
-    mstch::data reflection_data{mstch::data::type::object};
-    reflection_data.set("type_name", reflection.qualified_type_name);
-
-    mstch::data field_member_checks{mstch::data::type::list};
-    mstch::data method_member_checks{mstch::data::type::list};
-    mstch::data field_member_infos{mstch::data::type::list};
-    mstch::data method_member_infos{mstch::data::type::list};
-
-    for (size_t i = 0; i < reflection.fields.size(); i++) {
-        mstch::data member_check{mstch::data::type::object};
-        member_check.set("field_name", reflection.fields[i].name);
-        member_check.set("field_qualified_type_name", reflection.fields[i].qualified_type_name);
-        field_member_checks << member_check;
-
-        mstch::data member_info{mstch::data::type::object};
-        member_info.set("field_name", reflection.fields[i].name);
-        member_info.set("field_qualified_name", reflection.fields[i].qualified_name);
-        member_info.set("delimiter", i == reflection.fields.size() - 1 ? "" : ",");
-        field_member_infos << member_info;
-    }
-
-    for (size_t i = 0; i < reflection.methods.size(); i++) {
-        mstch::data member_check{mstch::data::type::object};
-        member_check.set("method_name", reflection.methods[i].name);
-        member_check.set("method_return_type", reflection.methods[i].qualified_return_type_name);
-        member_check.set("delimiter", i == reflection.methods.size() - 1 ? "," : "&&");
-
-        mstch::data params{mstch::data::type::list};
-        for (size_t j = 0; j < reflection.methods[i].param_type_list.size(); j++) {
-            mstch::data param{mstch::data::type::object};
-            param.set("param_type", reflection.methods[i].param_type_list[j]);
-            param.set("delimiter", j == reflection.methods[i].param_type_list.size() - 1 ? "" : ", ");
-            params << param;
-        }
-        member_check.set("params", params);
-        method_member_checks << member_check;
-
-        mstch::data member_info{mstch::data::type::object};
-        member_info.set("method_name", reflection.methods[i].name);
-        member_info.set("method_qualified_name", reflection.methods[i].qualified_name);
-        member_info.set("delimiter", i == reflection.methods.size() - 1 ? "" : ",");
-        method_member_infos << member_info;
-    }
-
-    reflection_data.set("field_member_checks", field_member_checks);
-    reflection_data.set("field_member_infos", field_member_infos);
-    reflection_data.set("method_member_checks", method_member_checks);
-    reflection_data.set("method_member_infos", method_member_infos);
-    auto result = reflection_template.render(reflection_data);
-    return result;
-}
-
-std::string GenerateForwardDeclarationForType(const TypeData& type_data) {
-    namespace mstch = kainjow::mustache;
-    mstch::mustache forward_declaration_template{R"(
-{{#openings}}
-namespace {{namespace}} {
-{{/openings}}
-{{#template_decl}}
-template <{{#template_params}}{{typename_or_type}} {{{param_name}}} {{delimiter}}{{/template_params}}> struct {{type_name}};
-{{/template_decl}}
-{{^template_decl}}
-struct {{{type_name}}};
-{{/template_decl}}
-{{#closings}}
-}
-{{/closings}}
-    )"};
-    mstch::data forward_declaration_data{mstch::data::type::object};
-    mstch::data openings{mstch::data::type::list};
-    mstch::data closings{mstch::data::type::list};
-    for (const auto& namespace_name : type_data.namespaces) {
-        openings << mstch::data("namespace", namespace_name);
-        closings << mstch::data();
-    }
-    forward_declaration_data.set("openings", openings);
-    forward_declaration_data.set("closings", closings);
-    if (type_data.is_templated) {
-        std::stringstream ss;
-        ss << type_data.name << "<";
-        mstch::data template_decl{mstch::data::type::list};
-        mstch::data template_info{mstch::data::type::object};
-        mstch::data template_params{mstch::data::type::list};
-        for (size_t i = 0; i < type_data.template_params.size(); i++) {
-            const auto& p = type_data.template_params[i];
-            mstch::data template_param{mstch::data::type::object};
-            template_param.set("typename_or_type", p.is_type ? "typename" : p.non_type_type_name);
-            template_param.set("param_name", p.name);
-            std::string delimiter = i == type_data.template_params.size() - 1 ? "" : ",";
-            template_param.set("delimiter", delimiter);
-            template_params << template_param;
-
-            ss << (p.is_type ? ("::" + p.instantiated_type_name) : p.non_type_value) << delimiter;
-        }
-        ss << ">";
-        template_info.set("template_params", template_params);
-        template_info.set("type_name", type_data.name);
-        template_decl << template_info;
-        forward_declaration_data.set("template_decl", template_decl);
-        forward_declaration_data.set("type_name", ss.str());
-    } else {
-        forward_declaration_data.set("type_name", type_data.name);
+        method_data.name = Intern(method->getNameAsString());
+        method_data.qualified_name = Intern(method->getQualifiedNameAsString());
+        method_data.qualified_return_type_name = TypeSpelling(method->getReturnType(), ctx);
+        method_data.canonical_return_type_name = CanonicalTypeName(method->getReturnType(), ctx);
+        method_data.is_public = method->getAccess() == clang::AS_public;
+        method_data.is_deleted = method->isDeleted();
+        method_data.is_const = method->isConst();
+        method_data.is_rvalue_ref = method->getRefQualifier() == clang::RQ_RValue;
+        InspectType(method->getReturnType(), ctx, tables);
+        llvm::SmallVector<llvm::StringRef, 8> param_type_list;
+        llvm::SmallVector<llvm::StringRef, 8> canonical_param_type_list;
+        llvm::SmallVector<bool, 8> lvalue_ref_params;
+        for (const clang::ParmVarDecl* param : method->parameters()) {
+            param_type_list.emplace_back(TypeSpelling(param->getType(), ctx));
+            canonical_param_type_list.emplace_back(CanonicalTypeName(param->getType(), ctx));
+            lvalue_ref_params.push_back(param->getType()->isLValueReferenceType());
+            InspectType(param->getType(), ctx, tables);
+        }
+        method_data.param_type_list = Intern(param_type_list);
+        method_data.canonical_param_type_list = Intern(canonical_param_type_list);
+        method_data.lvalue_ref_params = ArenaCopy(llvm::makeArrayRef(lvalue_ref_params));
+        method_data.method_qualified_type_name = Intern(
+            (method_data.qualified_return_type_name + " (T::*)(" + llvm::join(param_type_list, ", ") + ")").str());
+        methods.emplace_back(method_data);
     }
-    return forward_declaration_template.render(forward_declaration_data);
+    reflection.fields = ArenaCopy(llvm::makeArrayRef(fields));
+    reflection.methods = ArenaCopy(llvm::makeArrayRef(methods));
+    std::sort(opaque_ranges.begin(), opaque_ranges.end(), [](const LayoutRange& a, const LayoutRange& b) {
+        return a.offset < b.offset;
+    });
+    reflection.opaque_ranges = ArenaCopy(llvm::makeArrayRef(opaque_ranges));
 }
 
-auto Reflect(const clang::RecordDecl* record_decl) {
+auto Reflect(const clang::RecordDecl* record_decl, ReflectionTables& tables) {
     auto& ctx = record_decl->getASTContext();
     ReflectionData reflection;
     if (auto specialization = llvm::dyn_cast<clang::ClassTemplateSpecializationDecl>(record_decl)) {
         // reflection.qualified_type_name = specialization->getQualifiedNameAsString();
-        ReflectImpl(specialization, ctx, reflection);
+        ReflectImpl(specialization, ctx, reflection, tables);
     } else if (auto decl = llvm::dyn_cast<clang::CXXRecordDecl>(record_decl)) {
         // reflection.qualified_type_name = decl->getQualifiedNameAsString();
-        ReflectImpl(decl, ctx, reflection);
+        ReflectImpl(decl, ctx, reflection, tables);
     }
     return reflection;
 }
 
+EnumData ReflectEnum(const clang::EnumDecl* enum_decl) {
+    auto& ctx = enum_decl->getASTContext();
+    EnumData result;
+    result.name = Intern(enum_decl->getNameAsString());
+    result.namespaces = EnclosingNamespaces(enum_decl);
+    result.underlying_type_name = CanonicalTypeName(enum_decl->getIntegerType(), ctx);
+    result.is_scoped = enum_decl->isScoped();
+    result.is_signed = enum_decl->getIntegerType()->isSignedIntegerOrEnumerationType();
+    result.can_forward_declare =
+        enum_decl->isFixed() && enum_decl->getDeclContext()->getRedeclContext()->isFileContext() &&
+        !enum_decl->isInAnonymousNamespace();
+    llvm::SmallVector<EnumeratorData, 16> enumerators;
+    for (const clang::EnumConstantDecl* enumerator : enum_decl->enumerators()) {
+        EnumeratorData enumerator_data;
+        enumerator_data.name = Intern(enumerator->getNameAsString());
+        // Extending to 64 bits follows the signedness of the value, so the bits are right either way.
+        enumerator_data.value = static_cast<int64_t>(enumerator->getInitVal().extOrTrunc(64).getZExtValue());
+        enumerators.emplace_back(enumerator_data);
+    }
+    result.enumerators = ArenaCopy(llvm::makeArrayRef(enumerators));
+    return result;
+}
+
 class ReflectHandler : public MatchCallback {
 public:
+    ReflectHandler(ReflectionTables& tables, SourceStats& stats)
+        : tables_(tables)
+        , stats_(stats) {}
+
     virtual void run(const MatchResult& result) override {
         auto node = result.Nodes.getNodeAs<clang::ClassTemplateSpecializationDecl>(bind_name);
         if (!node) {
             return;
         }
+        HandleSpecialization(node);
+    }
+
+    void HandleSpecialization(const clang::ClassTemplateSpecializationDecl* node) {
         auto specialization = node->getSpecializedTemplate();
         if (!specialization) {
             return;
@@ -335,125 +476,753 @@ public:
             if (arg.getKind() != clang::TemplateArgument::ArgKind::Type) {
                 continue;
             }
-            auto qual_type = arg.getAsType();
-            if (!qual_type->getAs<clang::RecordType>()) {
+            auto qual_type = arg.getAsType().getCanonicalType().getUnqualifiedType();
+            if (auto enum_type = qual_type->getAs<clang::EnumType>()) {
+                HandleEnum(qual_type, enum_type->getDecl(), node->getASTContext());
                 continue;
             }
-            InspectType(qual_type, node->getASTContext());
-            auto type_ptr = qual_type.getTypePtrOrNull();
-            if (g_reflection_table.find(type_ptr) != g_reflection_table.end()) {
+            auto record_type = qual_type->getAs<clang::RecordType>();
+            if (!record_type) {
+                continue;
+            }
+            auto type_ptr = InspectType(qual_type, node->getASTContext(), tables_);
+            auto record_decl = record_type->getDecl();
+            if (tables_.reflection_table.count(record_decl->getCanonicalDecl())) {
                 continue; // already reflected
             }
-            auto record_decl = qual_type->getAs<clang::RecordType>()->getDecl();
             auto policy = node->getASTContext().getPrintingPolicy();
             policy.SuppressDefaultTemplateArgs = false;
-            ReflectionData reflection_data = Reflect(record_decl);
-            reflection_data.qualified_type_name = qual_type.getAsString(policy);
+            auto qualified_type_name = Intern(qual_type.getAsString(policy));
+            PhaseTimer timer(stats_.reflect_seconds, "Reflect", qualified_type_name);
+            ReflectionData reflection_data = Reflect(record_decl, tables_);
+            reflection_data.qualified_type_name = qualified_type_name;
+            reflection_data.canonical_type_name = CanonicalTypeName(qual_type, node->getASTContext());
             reflection_data.type_ptr = type_ptr;
-            g_reflection_table.insert({type_ptr, reflection_data});
+            tables_.reflection_table.try_emplace(record_decl->getCanonicalDecl(), std::move(reflection_data));
             continue; // only first argument is important
         };
     }
 
+    SourceStats& stats() {
+        return stats_;
+    }
+
 private:
+    void HandleEnum(clang::QualType qual_type, const clang::EnumDecl* enum_decl, const clang::ASTContext& ctx) {
+        enum_decl = enum_decl->getDefinition();
+        if (!enum_decl || tables_.enum_table.count(enum_decl->getCanonicalDecl())) {
+            return; // opaque or already reflected
+        }
+        auto policy = ctx.getPrintingPolicy();
+        policy.SuppressDefaultTemplateArgs = false;
+        auto qualified_type_name = Intern(qual_type.getAsString(policy));
+        PhaseTimer timer(stats_.reflect_seconds, "Reflect", qualified_type_name);
+        EnumData enum_data = ReflectEnum(enum_decl);
+        enum_data.qualified_type_name = qualified_type_name;
+        enum_data.canonical_type_name = CanonicalTypeName(qual_type, ctx);
+        tables_.enum_table.try_emplace(enum_decl->getCanonicalDecl(), enum_data);
+    }
+
+    ReflectionTables& tables_;
+    SourceStats& stats_;
 };
 
-static llvm::cl::OptionCategory ReflectToolCategory("Reflect Tool Options");
+// Times the matcher's pass over the parsed AST, which is all the consumer of a MatchFinder does.
+class TimedMatchConsumer : public clang::ASTConsumer {
+public:
+    TimedMatchConsumer(std::unique_ptr<clang::ASTConsumer> consumer, SourceStats& stats)
+        : consumer_(std::move(consumer))
+        , stats_(stats) {}
+
+    void HandleTranslationUnit(clang::ASTContext& ctx) override {
+        PhaseTimer timer(stats_.match_seconds, "Match");
+        consumer_->HandleTranslationUnit(ctx);
+    }
+
+private:
+    std::unique_ptr<clang::ASTConsumer> consumer_;
+    SourceStats& stats_;
+};
+
+// Consumer used by --fast. Rather than matching over the whole AST, it looks the reflect template up at translation
+// unit scope and visits its specializations directly. It also lets the parser skip every function body that cannot
+// name reflect<...> itself: bodies in system headers and in files that never spell the template's name.
+class FastReflectConsumer : public clang::ASTConsumer {
+public:
+    FastReflectConsumer(const clang::SourceManager& source_manager, ReflectHandler& handler)
+        : source_manager_(source_manager)
+        , handler_(handler) {}
+
+    bool shouldSkipFunctionBody(clang::Decl* decl) override {
+        auto location = source_manager_.getExpansionLoc(decl->getLocation());
+        if (location.isInvalid()) {
+            return false;
+        }
+        if (source_manager_.isInSystemHeader(location)) {
+            return true;
+        }
+        auto file_id = source_manager_.getFileID(location);
+        auto [it, inserted] = file_mentions_reflect_.try_emplace(file_id, true);
+        if (inserted) {
+            bool invalid = false;
+            auto buffer = source_manager_.getBufferData(file_id, &invalid);
+            it->second = invalid || buffer.contains(reflection_name);
+        }
+        return !it->second;
+    }
 
-static inline std::string GeneratePreambleCode() {
-    namespace mstch = kainjow::mustache;
-    mstch::mustache preamble_template{R"(
-#pragma once
-// preamble-begin
-#include <type_traits>
-#include <string>
-
-template<class T, class V = void>
-struct member_info {
-    using value_type = V;
-    std::string name;
-    V T::* ptr = nullptr;
+    void HandleTranslationUnit(clang::ASTContext& ctx) override {
+        PhaseTimer timer(handler_.stats().match_seconds, "Match");
+        auto* translation_unit = ctx.getTranslationUnitDecl();
+        for (auto* decl : translation_unit->lookup(&ctx.Idents.get(reflection_name))) {
+            auto* templ_decl = llvm::dyn_cast<clang::ClassTemplateDecl>(decl);
+            if (!templ_decl) {
+                continue;
+            }
+            for (auto* specialization : templ_decl->specializations()) {
+                if (clang::isTemplateInstantiation(specialization->getTemplateSpecializationKind())) {
+                    handler_.HandleSpecialization(specialization);
+                }
+            }
+            break; // every redeclaration shares the same specializations
+        }
+    }
+
+private:
+    const clang::SourceManager& source_manager_;
+    ReflectHandler& handler_;
+    llvm::DenseMap<clang::FileID, bool> file_mentions_reflect_;
 };
 
-template<typename T, typename F>
-struct method_info {
-    using method_type = F;
-    std::string_view name;
-    F func_ptr;
+// Everything produced for one entry of the source list.
+struct SourceResult {
+    // Holds the arrays of |reflection|'s entries, which go away with the result when the source is parsed again.
+    std::unique_ptr<llvm::BumpPtrAllocator> arena = std::make_unique<llvm::BumpPtrAllocator>();
+    ReflectionResult reflection;
+    std::vector<std::string> dependencies; // every file the TU read, used to validate cache entries
+    llvm::StringMap<uint64_t> read_hashes; // ReflectionCache::HashContents() of the dependencies Clang loaded
+    SourceStats stats;
 };
 
-template<typename T, typename Enable = void>
-struct reflect {
+// Matches a single translation unit with fresh tables and merges them into the source's result once the TU is done.
+class ReflectAction : public clang::ASTFrontendAction {
+public:
+    ReflectAction(SourceResult& output, bool fast)
+        : output_(output)
+        , fast_(fast) {
+        using namespace clang::ast_matchers;
+        // Match all uses of reflect<T> in type locations
+        finder_.addMatcher(
+            classTemplateSpecializationDecl(hasName(reflection_name), isTemplateInstantiation()).bind(bind_name),
+            &handler_);
+    }
+
+    bool BeginInvocation(clang::CompilerInstance& compiler) override {
+        if (fast_) {
+            compiler.getFrontendOpts().SkipFunctionBodies = true;
+        }
+        return true;
+    }
+
+    std::unique_ptr<clang::ASTConsumer> CreateASTConsumer(clang::CompilerInstance& compiler, llvm::StringRef) override {
+        if (fast_) {
+            return std::make_unique<FastReflectConsumer>(compiler.getSourceManager(), handler_);
+        }
+        return std::make_unique<TimedMatchConsumer>(finder_.newASTConsumer(), output_.stats);
+    }
+
+    void EndSourceFileAction() override {
+        auto& stats = output_.stats;
+        stats.types_inspected += tables_.inspected_types.size();
+        stats.type_cache_hits += tables_.type_cache_hits;
+        stats.reflections += tables_.reflection_table.size() + tables_.enum_table.size();
+        for (const auto& [record_decl, reflection] : tables_.reflection_table) {
+            stats.fields += reflection.fields.size();
+            stats.methods += reflection.methods.size();
+        }
+        MergeReflectionTables(tables_, output_.reflection);
+        auto& source_manager = getCompilerInstance().getSourceManager();
+        for (auto it = source_manager.fileinfo_begin(); it != source_manager.fileinfo_end(); ++it) {
+            auto real_path = it->first->tryGetRealPathName();
+            auto& path = output_.dependencies.emplace_back(real_path.empty() ? it->first->getName() : real_path);
+            // The bytes that were parsed, not those on disk by the time the entry is stored.
+            if (auto contents = it->second->getBufferDataIfLoaded()) {
+                output_.read_hashes[path] = ReflectionCache::HashContents(*contents);
+            }
+        }
+    }
+
 private:
-    static constexpr auto size = sizeof(T); // always trigger instantiation if T is templated
+    SourceResult& output_;
+    bool fast_;
+    ReflectionTables tables_;
+    ReflectHandler handler_{tables_, output_.stats};
+    MatchFinder finder_;
 };
 
-{{#forward_declarations}}
-{{{forward_declaration}}}
-{{/forward_declarations}}
-// preamble-end
-)"};
-    mstch::data preamble_data{mstch::data::type::object};
-    mstch::data forward_declarations{mstch::data::type::list};
-    for (const auto& [type_ptr, type_data] : g_type_infos) {
-        if (type_ptr->isBuiltinType()) {
-            continue;
+class ReflectActionFactory : public clang::tooling::FrontendActionFactory {
+public:
+    ReflectActionFactory(SourceResult& output, bool fast)
+        : output_(output)
+        , fast_(fast) {}
+
+    std::unique_ptr<clang::FrontendAction> create() override {
+        return std::make_unique<ReflectAction>(output_, fast_);
+    }
+
+private:
+    SourceResult& output_;
+    bool fast_;
+};
+
+// Writes the precompiled header to the path given by --pch, wherever the compile command would have put it.
+class BuildPchAction : public clang::GeneratePCHAction {
+public:
+    explicit BuildPchAction(std::string output_path)
+        : output_path_(std::move(output_path)) {}
+
+    bool BeginInvocation(clang::CompilerInstance& compiler) override {
+        compiler.getFrontendOpts().OutputFile = output_path_;
+        return clang::GeneratePCHAction::BeginInvocation(compiler);
+    }
+
+private:
+    std::string output_path_;
+};
+
+class BuildPchActionFactory : public clang::tooling::FrontendActionFactory {
+public:
+    explicit BuildPchActionFactory(std::string output_path)
+        : output_path_(std::move(output_path)) {}
+
+    std::unique_ptr<clang::FrontendAction> create() override {
+        return std::make_unique<BuildPchAction>(output_path_);
+    }
+
+private:
+    std::string output_path_;
+};
+
+static llvm::cl::OptionCategory ReflectToolCategory("Reflect Tool Options");
+
+static llvm::cl::opt<unsigned> Jobs("j",
+                                    llvm::cl::desc("Number of translation units to parse concurrently "
+                                                   "(0 = one per hardware thread)"),
+                                    llvm::cl::init(1),
+                                    llvm::cl::cat(ReflectToolCategory));
+
+static llvm::cl::opt<std::string> OutputFilename("o",
+                                                 llvm::cl::desc("Write the generated header to <filename> "
+                                                                "instead of stdout"),
+                                                 llvm::cl::value_desc("filename"),
+                                                 llvm::cl::init("-"),
+                                                 llvm::cl::cat(ReflectToolCategory));
+
+static llvm::cl::opt<std::string> OutputDir("output-dir",
+                                            llvm::cl::desc("Write one header per reflected type, a preamble and an "
+                                                           "umbrella header into <directory>; unchanged files are "
+                                                           "not rewritten"),
+                                            llvm::cl::value_desc("directory"),
+                                            llvm::cl::cat(ReflectToolCategory));
+
+static llvm::cl::opt<std::string> DepFile("depfile",
+                                          llvm::cl::desc("Write a Make/Ninja depfile listing every file the "
+                                                         "generated output depends on"),
+                                          llvm::cl::value_desc("filename"),
+                                          llvm::cl::cat(ReflectToolCategory));
+
+static llvm::cl::opt<bool> Descriptors("descriptors",
+                                       llvm::cl::desc("Generate constexpr field/method descriptors with field_count, "
+                                                      "field<I>() and for_each_field() instead of std::tuple based "
+                                                      "fields()/methods(); much cheaper to compile for wide types"),
+                                       llvm::cl::cat(ReflectToolCategory));
+
+static llvm::cl::opt<bool> NameLookup("name-lookup",
+                                      llvm::cl::desc("Generate field_index_of()/method_index_of() backed by a perfect "
+                                                     "hash of the member names, and visit_field()/visit_method() "
+                                                     "to reach a member by its runtime name in constant time"),
+                                      llvm::cl::cat(ReflectToolCategory));
+
+static llvm::cl::opt<bool> Layout("layout",
+                                  llvm::cl::desc("Generate field offsets, sizes and alignments, type size and "
+                                                 "alignment, padding holes, triviality flags and the runs of "
+                                                 "fields that can be copied with a single memcpy"),
+                                  llvm::cl::cat(ReflectToolCategory));
+
+static llvm::cl::opt<bool> Soa("soa",
+                               llvm::cl::desc("Generate a structure-of-arrays soa_vector<T> for every reflected type, "
+                                              "with one contiguous column per field"),
+                               llvm::cl::cat(ReflectToolCategory));
+
+static llvm::cl::opt<bool> Serializer("serializer",
+                                      llvm::cl::desc("Generate binary serialize()/deserialize() support for every "
+                                                     "reflected type, copying runs of contiguous trivially copyable "
+                                                     "fields with a single memcpy"),
+                                      llvm::cl::cat(ReflectToolCategory));
+
+static llvm::cl::opt<bool> Json("json",
+                                llvm::cl::desc("Generate a streaming JSON writer and reader for every reflected type "
+                                               "that fills the object directly, without an intermediate DOM"),
+                                llvm::cl::cat(ReflectToolCategory));
+
+static llvm::cl::opt<bool> RuntimeRegistry("registry",
+                                           llvm::cl::desc("Generate a flat, constexpr runtime registry of every known "
+                                                          "type with its fields, methods and template arguments"),
+                                           llvm::cl::cat(ReflectToolCategory));
+
+static llvm::cl::opt<std::string> SchemaFile("schema-file",
+                                             llvm::cl::desc("Also write the --registry tables to <filename> as a "
+                                                            "binary schema that can be mapped at runtime"),
+                                             llvm::cl::value_desc("filename"),
+                                             llvm::cl::cat(ReflectToolCategory));
+
+static llvm::cl::opt<bool> Invokers("invokers",
+                                    llvm::cl::desc("Generate a void(void* object, void* const* args, void* result) "
+                                                   "thunk per method and a per-type invokers table to call methods "
+                                                   "without std::function or argument boxing"),
+                                    llvm::cl::cat(ReflectToolCategory));
+
+static llvm::cl::opt<bool> SchemaHash("schema-hash",
+                                      llvm::cl::desc("Generate a constexpr 64-bit schema_hash in every reflect<T>, "
+                                                     "derived from the names, canonical types and order of its "
+                                                     "fields and the schema hashes of the types nested in it"),
+                                      llvm::cl::cat(ReflectToolCategory));
+
+static llvm::cl::opt<std::string> SchemaHashManifest("schema-hash-manifest",
+                                                     llvm::cl::desc("Write the schema hash of every reflected type "
+                                                                    "to <filename>, one \"<hash> <type>\" line each"),
+                                                     llvm::cl::value_desc("filename"),
+                                                     llvm::cl::cat(ReflectToolCategory));
+
+static llvm::cl::opt<bool> Fast("fast",
+                                llvm::cl::desc("Find reflect<...> specializations by lookup instead of matching the "
+                                               "whole AST, and skip function bodies in system headers and in files "
+                                               "that never mention reflect. Uses reached only through templates "
+                                               "instantiated from such skipped bodies are not seen"),
+                                llvm::cl::cat(ReflectToolCategory));
+
+static llvm::cl::opt<std::string> Pch("pch",
+                                      llvm::cl::desc("Precompiled header to include into every translation unit"),
+                                      llvm::cl::value_desc("filename"),
+                                      llvm::cl::cat(ReflectToolCategory));
+
+static llvm::cl::opt<std::string> PchHeader("pch-header",
+                                            llvm::cl::desc("Header of common includes to precompile into --pch "
+                                                           "before any translation unit is parsed"),
+                                            llvm::cl::value_desc("filename"),
+                                            llvm::cl::cat(ReflectToolCategory));
+
+static llvm::cl::opt<std::string> CacheDir("cache-dir",
+                                           llvm::cl::desc("Directory for per translation unit results; unchanged "
+                                                          "translation units are loaded from it instead of parsed"),
+                                           llvm::cl::value_desc("directory"),
+                                           llvm::cl::cat(ReflectToolCategory));
+
+static llvm::cl::opt<bool> Stats("stats",
+                                 llvm::cl::desc("Print per translation unit and per phase timings and counts of "
+                                                "inspected types, type cache hits, fields, methods and emitted "
+                                                "bytes to stderr"),
+                                 llvm::cl::cat(ReflectToolCategory));
+
+static llvm::cl::opt<std::string> TimeTrace("time-trace",
+                                            llvm::cl::desc("Write a Chrome trace of the run, with Clang's own "
+                                                           "frontend events nested in it, to <filename>"),
+                                            llvm::cl::value_desc("filename"),
+                                            llvm::cl::cat(ReflectToolCategory));
+
+static llvm::cl::opt<unsigned> TimeTraceGranularity("time-trace-granularity",
+                                                    llvm::cl::desc("Minimum duration in microseconds of the events "
+                                                                   "recorded by --time-trace"),
+                                                    llvm::cl::init(500),
+                                                    llvm::cl::cat(ReflectToolCategory));
+
+static llvm::cl::opt<std::string> Serve("serve",
+                                        llvm::cl::desc("Stay resident and regenerate the output whenever a client "
+                                                       "asks on the Unix domain socket <path>, parsing only the "
+                                                       "sources that read a changed file"),
+                                        llvm::cl::value_desc("path"),
+                                        llvm::cl::cat(ReflectToolCategory));
+
+static llvm::cl::opt<std::string> Connect("connect",
+                                          llvm::cl::desc("Ask the --serve server listening on <path> to regenerate, "
+                                                         "and exit with its status; no other option is needed"),
+                                          llvm::cl::value_desc("path"),
+                                          llvm::cl::cat(ReflectToolCategory));
+
+static llvm::cl::opt<bool> Shutdown("shutdown",
+                                    llvm::cl::desc("With --connect, stop the server instead"),
+                                    llvm::cl::cat(ReflectToolCategory));
+
+// Produces the reflection data of a single source file, from the cache when none of its inputs changed.
+static void ProcessSource(const clang::tooling::CompilationDatabase& compilations,
+                          const std::string& source,
+                          ReflectionCache* cache,
+                          SourceResult& output) {
+    using namespace clang::tooling;
+
+    output.stats.source = source;
+    PhaseTimer timer(output.stats.total_seconds, "Source", source);
+    ArenaScope arena_scope(*output.arena);
+
+    // Each tool gets its own physical file system so that working directory changes stay thread local.
+    llvm::IntrusiveRefCntPtr<llvm::vfs::FileSystem> fs(llvm::vfs::createPhysicalFileSystem().release());
+    std::string absolute_source = source;
+    std::vector<CompileCommand> commands;
+    if (cache) {
+        if (auto path = getAbsolutePath(*fs, source)) {
+            absolute_source = std::move(*path);
+        } else {
+            llvm::consumeError(path.takeError());
         }
-        forward_declarations << mstch::data("forward_declaration", GenerateForwardDeclarationForType(type_data));
+        commands = compilations.getCompileCommands(absolute_source);
+        if (cache->Load(absolute_source, commands, output.reflection, output.dependencies)) {
+            output.stats.cached = true;
+            return;
+        }
+    }
+
+    ClangTool tool(compilations, {source}, std::make_shared<clang::PCHContainerOperations>(), fs);
+    if (!Pch.empty()) {
+        tool.appendArgumentsAdjuster(
+            getInsertArgumentAdjuster(CommandLineArguments{"-include-pch", Pch}, ArgumentInsertPosition::BEGIN));
+        llvm::SmallString<256> pch_path(Pch);
+        llvm::sys::fs::make_absolute(pch_path);
+        output.dependencies.emplace_back(pch_path);
+    }
+    ReflectActionFactory factory(output, Fast);
+    int status;
+    {
+        PhaseTimer frontend_timer(output.stats.frontend_seconds, "Clang tool", source);
+        status = tool.run(&factory);
+    }
+
+    auto& dependencies = output.dependencies;
+    std::sort(dependencies.begin(), dependencies.end());
+    dependencies.erase(std::unique(dependencies.begin(), dependencies.end()), dependencies.end());
+    if (cache && status == 0) {
+        cache->Store(absolute_source, commands, output.reflection, dependencies, output.read_hashes);
     }
-    preamble_data.set("forward_declarations", forward_declarations);
-    return preamble_template.render(preamble_data);
 }
 
-static inline std::string GenerateReflectionCode() {
-    namespace mstch = kainjow::mustache;
-    mstch::mustache reflection_code_template{R"(
-// reflection-begin
-{{#reflections}}
-{{{class_reflection}}}
-{{/reflections}}
-// reflection-end
-    )"};
-    mstch::data reflection_code_data{mstch::data::type::object};
-    mstch::data reflections{mstch::data::type::list};
-    for (const auto& [type_ptr, reflection] : g_reflection_table) {
-        reflections << mstch::data("class_reflection", GenerateClassReflectionCode(reflection));
-    }
-    reflection_code_data.set("reflections", reflections);
-    return reflection_code_template.render(reflection_code_data);
+// Precompiles --pch-header into --pch, using the compile command the compilation database has for the header.
+static bool BuildPch(const clang::tooling::CompilationDatabase& compilations) {
+    using namespace clang::tooling;
+
+    ClangTool tool(compilations, {PchHeader.getValue()});
+    tool.appendArgumentsAdjuster(
+        getInsertArgumentAdjuster(CommandLineArguments{"-x", "c++-header"}, ArgumentInsertPosition::BEGIN));
+    BuildPchActionFactory factory(Pch);
+    return tool.run(&factory) == 0;
 }
 
-static inline std::string GenerateFullReflectionFile() {
-    namespace mstch = kainjow::mustache;
-    mstch::mustache code_template{R"(
-{{{preamble}}}
-
-{{{reflections}}}
-    )"};
-    mstch::data code_data{mstch::data::type::object};
-    code_data.set("preamble", GeneratePreambleCode());
-    code_data.set("reflections", GenerateReflectionCode());
-    return code_template.render(code_data);
-};
+// Processes the sources at |indices| into the matching entries of |results|, on a thread pool when -j asks for it.
+static void ProcessSources(const clang::tooling::CompilationDatabase& compilations,
+                           const std::vector<std::string>& sources,
+                           llvm::ArrayRef<size_t> indices,
+                           ReflectionCache* cache,
+                           std::vector<SourceResult>& results,
+                           RunStats& stats) {
+    PhaseTimer timer(stats.process_seconds, "Process sources");
+    for (auto i : indices) {
+        results[i] = SourceResult();
+    }
+    if (Jobs == 1 || indices.size() <= 1) {
+        for (auto i : indices) {
+            ProcessSource(compilations, sources[i], cache, results[i]);
+        }
+    } else {
+        llvm::ThreadPool pool(llvm::hardware_concurrency(Jobs));
+        bool trace = llvm::timeTraceProfilerEnabled();
+        for (auto i : indices) {
+            pool.async([&, i, trace] {
+                // The profiler is per thread; every source is traced on its own and merged when it is written.
+                if (trace) {
+                    llvm::timeTraceProfilerInitialize(TimeTraceGranularity, "refl");
+                }
+                ProcessSource(compilations, sources[i], cache, results[i]);
+                if (trace) {
+                    llvm::timeTraceProfilerFinishThread();
+                }
+            });
+        }
+        pool.wait();
+    }
+}
+
+// Every source gets its own result, and the results are merged in source list order, so the output does not depend
+// on the number of jobs. |results| is left intact for --serve, which merges the same results again on every request.
+static void MergeSources(const std::vector<SourceResult>& results,
+                         ReflectionResult& result,
+                         std::vector<std::string>& dependencies,
+                         RunStats& stats) {
+    PhaseTimer timer(stats.merge_seconds, "Merge");
+    for (const auto& source_result : results) {
+        MergeReflectionResult(source_result.reflection, result);
+        dependencies.insert(
+            dependencies.end(), source_result.dependencies.begin(), source_result.dependencies.end());
+        stats.sources.emplace_back(source_result.stats);
+    }
+    AssignSchemaHashes(result);
+    std::sort(dependencies.begin(), dependencies.end());
+    dependencies.erase(std::unique(dependencies.begin(), dependencies.end()), dependencies.end());
+    stats.types = result.type_infos.size();
+    stats.reflections = result.reflection_table.size() + result.enum_table.size();
+    stats.arena_bytes = ArenaBytes();
+    for (const auto& source_result : results) {
+        stats.arena_bytes += source_result.arena->getTotalMemory();
+    }
+}
+
+// Writes the schema file, the schema hash manifest, the generated header(s) and the depfile. With |keep_unchanged| the
+// single output header is only rewritten when its content changes, which the sharded headers always are.
+static bool WriteOutputs(const ReflectionResult& result,
+                         const std::vector<std::string>& dependencies,
+                         const EmitOptions& emit_options,
+                         bool keep_unchanged,
+                         RunStats& stats) {
+    PhaseTimer timer(stats.emit_seconds, "Emit");
+    if (!SchemaFile.empty() && !WriteFileIfChanged(SchemaFile, SerializeRegistry(BuildRegistry(result)))) {
+        return false;
+    }
+    if (!SchemaHashManifest.empty()) {
+        std::string manifest;
+        llvm::raw_string_ostream os(manifest);
+        WriteSchemaHashManifest(os, result);
+        if (!WriteFileIfChanged(SchemaHashManifest, os.str())) {
+            return false;
+        }
+    }
+
+    if (!OutputDir.empty()) {
+        auto umbrella_path = WriteShardedOutput(OutputDir, result, emit_options, &stats.bytes_emitted);
+        if (umbrella_path.empty()) {
+            return false;
+        }
+        return DepFile.empty() || WriteDepfile(DepFile, umbrella_path, dependencies);
+    }
+
+    if (keep_unchanged) {
+        std::string content;
+        llvm::raw_string_ostream os(content);
+        EmitReflectionFile(os, result, emit_options);
+        stats.bytes_emitted = os.str().size();
+        if (!WriteFileIfChanged(OutputFilename, os.str())) {
+            return false;
+        }
+        return DepFile.empty() || WriteDepfile(DepFile, OutputFilename, dependencies);
+    }
+
+    // The emitters write every declaration straight into the buffered file stream, so the header is never held in
+    // memory as a whole.
+    std::error_code error;
+    llvm::ToolOutputFile output(OutputFilename, error, llvm::sys::fs::OF_Text);
+    if (error) {
+        llvm::errs() << "cannot open " << OutputFilename << ": " << error.message() << "\n";
+        return false;
+    }
+    EmitReflectionFile(output.os(), result, emit_options);
+    output.os().flush();
+    stats.bytes_emitted = output.os().tell();
+    if (output.os().has_error()) {
+        llvm::errs() << "cannot write " << OutputFilename << ": " << output.os().error().message() << "\n";
+        output.os().clear_error();
+        return false;
+    }
+    output.keep();
+    return DepFile.empty() || WriteDepfile(DepFile, OutputFilename, dependencies);
+}
+
+// The --serve loop. The compilation database, the results of every source and the interned metadata stay resident,
+// and a regenerate request only parses the sources that read a file changed since they were last processed; all other
+// results are merged from memory.
+static int RunServer(const clang::tooling::CompilationDatabase& compilations,
+                     const std::vector<std::string>& sources,
+                     ReflectionCache* cache,
+                     const EmitOptions& emit_options) {
+    std::vector<SourceResult> results(sources.size());
+    std::vector<bool> stale(sources.size(), true);
+    FileWatcher watcher;
+    llvm::StringMap<std::set<size_t>> readers; // file -> indices of the sources that read it
+
+    auto regenerate = [&](llvm::raw_ostream& reply) {
+        for (const auto& path : watcher.TakeChanges()) {
+            auto it = readers.find(path);
+            if (it != readers.end()) {
+                for (auto i : it->second) {
+                    stale[i] = true;
+                }
+            }
+        }
+        std::vector<size_t> indices;
+        for (size_t i = 0; i < sources.size(); i++) {
+            if (stale[i]) {
+                indices.push_back(i);
+            }
+        }
+
+        // Files are read from here on. One changed before being watched is still seen by comparing against this.
+        auto read_since = std::chrono::system_clock::now();
+        RunStats stats;
+        if (cache) {
+            cache->ForgetFileHashes();
+        }
+        ProcessSources(compilations, sources, indices, cache, results, stats);
+        for (auto i : indices) {
+            // A source that failed before reading anything is retried on the next request.
+            stale[i] = results[i].dependencies.empty();
+            for (const auto& dependency : results[i].dependencies) {
+                llvm::SmallString<256> path(dependency);
+                llvm::sys::fs::make_absolute(path);
+                watcher.Watch(path, read_since);
+                readers[path].insert(i);
+            }
+        }
+        ReflectionResult result;
+        std::vector<std::string> dependencies;
+        MergeSources(results, result, dependencies, stats);
+        bool written = WriteOutputs(result, dependencies, emit_options, /*keep_unchanged=*/true, stats);
+
+        reply << "reparsed " << indices.size() << " of " << sources.size() << " sources\n";
+        if (Stats) {
+            PrintStats(reply, stats);
+        }
+        return written ? 0 : 1;
+    };
+
+    if (regenerate(llvm::errs()) != 0) {
+        return 1;
+    }
+    bool served = ServeRequests(Serve.getValue(), watcher, [&](llvm::StringRef request, llvm::raw_ostream& reply) {
+        if (request != "regenerate") {
+            reply << "unknown request '" << request << "'\n";
+            return 1;
+        }
+        return regenerate(reply);
+    });
+    return served ? 0 : 1;
+}
+
+// The client has to start quickly, so it is recognized before the options are parsed, which loads the compilation
+// database. Returns the client's exit status if --connect was given.
+static std::optional<int> RunClientIfRequested(int argc, const char** argv) {
+    llvm::StringRef socket_path;
+    bool shutdown = false;
+    for (int i = 1; i < argc; i++) {
+        llvm::StringRef arg = argv[i];
+        if (arg == "--") {
+            break;
+        }
+        // Options take one dash or two, like llvm::cl does.
+        if (!arg.consume_front("-")) {
+            continue;
+        }
+        arg.consume_front("-");
+        if (arg.consume_front("connect=")) {
+            socket_path = arg;
+        } else if (arg == "connect" && i + 1 < argc) {
+            socket_path = argv[++i];
+        } else if (arg == "shutdown") {
+            shutdown = true;
+        }
+    }
+    if (socket_path.empty()) {
+        return std::nullopt;
+    }
+    return RunClient(socket_path, shutdown ? "shutdown" : "regenerate");
+}
 
 int main(int argc, const char** argv) {
     using namespace clang;
-    using namespace clang::ast_matchers;
     using namespace clang::tooling;
 
+    if (auto status = RunClientIfRequested(argc, argv)) {
+        return *status;
+    }
+
     auto OptionsParser = CommonOptionsParser::create(argc, argv, ReflectToolCategory);
-    ClangTool Tool(OptionsParser->getCompilations(), OptionsParser->getSourcePathList());
+    if (!OptionsParser) {
+        llvm::errs() << OptionsParser.takeError();
+        return 1;
+    }
+    const auto& sources = OptionsParser->getSourcePathList();
+
+    RunStats run_stats;
+    if (!TimeTrace.empty()) {
+        llvm::timeTraceProfilerInitialize(TimeTraceGranularity, "refl");
+    }
+    // Reported however the run ends, so that a failing run can be looked at as well.
+    auto report_stats = llvm::make_scope_exit([&] {
+        if (Stats && Serve.empty()) {
+            PrintStats(llvm::errs(), run_stats);
+        }
+        if (llvm::timeTraceProfilerEnabled()) {
+            if (auto error = llvm::timeTraceProfilerWrite(TimeTrace, "refl")) {
+                llvm::errs() << "cannot write " << TimeTrace << ": " << llvm::toString(std::move(error)) << "\n";
+            }
+            llvm::timeTraceProfilerCleanup();
+        }
+    });
+
+    if (!PchHeader.empty()) {
+        if (Pch.empty()) {
+            llvm::errs() << "--pch-header needs --pch to name the precompiled header\n";
+            return 1;
+        }
+        PhaseTimer timer(run_stats.pch_seconds, "Precompile header", PchHeader.getValue());
+        if (!BuildPch(OptionsParser->getCompilations())) {
+            llvm::errs() << "cannot precompile " << PchHeader << "\n";
+            return 1;
+        }
+    }
 
-    MatchFinder Finder;
-    ReflectHandler Handler;
+    std::unique_ptr<ReflectionCache> cache;
+    if (!CacheDir.empty()) {
+        // --fast can see fewer specializations, and the PCH changes what is parsed, so both are part of every key.
+        std::string configuration = Fast ? "fast" : "full";
+        if (!Pch.empty()) {
+            configuration += ";pch=" + Pch;
+        }
+        cache = std::make_unique<ReflectionCache>(CacheDir, configuration);
+    }
+
+    if (!DepFile.empty() && OutputDir.empty() && OutputFilename == "-") {
+        llvm::errs() << "--depfile needs an output file (-o) or an output directory (--output-dir)\n";
+        return 1;
+    }
+    if (!Serve.empty() && OutputDir.empty() && OutputFilename == "-") {
+        llvm::errs() << "--serve needs an output file (-o) or an output directory (--output-dir)\n";
+        return 1;
+    }
 
-    // Match all uses of reflect<T> in type locations
-    Finder.addMatcher(
-        classTemplateSpecializationDecl(hasName(reflection_name), isTemplateInstantiation()).bind(bind_name), &Handler);
+    EmitOptions emit_options;
+    emit_options.descriptors = Descriptors;
+    emit_options.name_lookup = NameLookup;
+    emit_options.layout = Layout;
+    emit_options.soa = Soa;
+    emit_options.serializer = Serializer;
+    emit_options.json = Json;
+    emit_options.registry = RuntimeRegistry;
+    emit_options.invokers = Invokers;
+    emit_options.schema_hash = SchemaHash;
+    if (!SchemaFile.empty() && !RuntimeRegistry) {
+        llvm::errs() << "--schema-file needs --registry for the types that read it\n";
+        return 1;
+    }
 
-    Tool.run(newFrontendActionFactory(&Finder).get());
+    if (!Serve.empty()) {
+        return RunServer(OptionsParser->getCompilations(), sources, cache.get(), emit_options);
+    }
 
-    std::cout << GenerateFullReflectionFile() << std::endl;
+    std::vector<SourceResult> results(sources.size());
+    std::vector<size_t> indices(sources.size());
+    std::iota(indices.begin(), indices.end(), 0);
+    ProcessSources(OptionsParser->getCompilations(), sources, indices, cache.get(), results, run_stats);
+    ReflectionResult result;
+    std::vector<std::string> dependencies;
+    MergeSources(results, result, dependencies, run_stats);
 
+    if (!WriteOutputs(result, dependencies, emit_options, /*keep_unchanged=*/false, run_stats)) {
+        return 1;
+    }
     return 0;
 }
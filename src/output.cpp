@@ -0,0 +1,273 @@
+#include "output.h"
+
+#include <cctype>
+#include <llvm/ADT/SmallString.h>
+#include <llvm/ADT/StringMap.h>
+#include <llvm/ADT/StringSet.h>
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/Format.h>
+#include <llvm/Support/MemoryBuffer.h>
+#include <llvm/Support/Path.h>
+#include <llvm/Support/raw_ostream.h>
+#include <llvm/Support/xxhash.h>
+
+#include "enum_emitter.h"
+#include "json_emitter.h"
+#include "registry.h"
+
+constexpr auto preamble_file_name = "reflect_preamble.h";
+constexpr auto umbrella_file_name = "reflect_all.h";
+constexpr auto registry_file_name = "reflect_registry.h";
+// Names of the headers the last run wrote into the directory, one per line, so that the next run removes only its own.
+constexpr auto manifest_file_name = "reflect_files.txt";
+
+// File name for the header of one reflected type. The readable part is truncated and may be shared by different
+// types (a::b and a_b), the hash of the full type name keeps the names apart.
+static std::string ShardFileName(llvm::StringRef type_name) {
+    constexpr size_t max_readable_length = 64;
+    std::string file_name = "reflect_";
+    bool last_was_separator = true;
+    for (char c : type_name) {
+        if (file_name.size() >= max_readable_length) {
+            break;
+        }
+        if (std::isalnum(static_cast<unsigned char>(c))) {
+            file_name += c;
+            last_was_separator = false;
+        } else if (!last_was_separator) {
+            file_name += '_';
+            last_was_separator = true;
+        }
+    }
+    if (!last_was_separator) {
+        file_name += '_';
+    }
+    llvm::raw_string_ostream(file_name) << llvm::format_hex_no_prefix(llvm::xxHash64(type_name) & 0xffffffff, 8)
+                                        << ".h";
+    return file_name;
+}
+
+bool WriteFileIfChanged(llvm::StringRef path, llvm::StringRef content) {
+    if (auto existing = llvm::MemoryBuffer::getFile(path, /*IsText=*/false, /*RequiresNullTerminator=*/false)) {
+        if ((*existing)->getBuffer() == content) {
+            return true;
+        }
+    }
+
+    // Write to a temporary and rename, so that a compile running in parallel never includes a half written header.
+    int fd;
+    llvm::SmallString<256> temp_path;
+    if (auto error = llvm::sys::fs::createUniqueFile(path + ".%%%%%%.tmp", fd, temp_path)) {
+        llvm::errs() << "cannot write " << path << ": " << error.message() << "\n";
+        return false;
+    }
+    {
+        llvm::raw_fd_ostream os(fd, /*shouldClose=*/true);
+        os << content;
+        os.close();
+        if (os.has_error()) {
+            llvm::errs() << "cannot write " << path << ": " << os.error().message() << "\n";
+            os.clear_error();
+            llvm::sys::fs::remove(temp_path);
+            return false;
+        }
+    }
+    if (auto error = llvm::sys::fs::rename(temp_path, path)) {
+        llvm::errs() << "cannot write " << path << ": " << error.message() << "\n";
+        llvm::sys::fs::remove(temp_path);
+        return false;
+    }
+    return true;
+}
+
+// Forward declarations for a single shard. A shard declares the types it spells out itself, so adding, removing or
+// renaming a type only rewrites the shards that name it instead of the preamble every shard includes.
+class ShardDeclarations {
+public:
+    explicit ShardDeclarations(const ReflectionResult& result) {
+        // Every specialization of a template shares one declaration of the template.
+        for (const auto& [type_name, type_data] : result.type_infos) {
+            types_.try_emplace(type_data.qualified_name.split('<').first, &type_data);
+        }
+        for (const auto& [type_name, enum_data] : result.enum_table) {
+            enums_.try_emplace(enum_data.qualified_type_name, &enum_data);
+        }
+    }
+
+    // Declares every known type among the qualified names in |spellings|, each once.
+    void Emit(llvm::raw_ostream& os, llvm::ArrayRef<llvm::StringRef> spellings) const {
+        llvm::StringSet<> declared;
+        for (auto spelling : spellings) {
+            while (!spelling.empty()) {
+                spelling = spelling.drop_until(IsNameChar);
+                auto name = spelling.take_while(IsNameChar);
+                spelling = spelling.drop_front(name.size());
+                name = name.ltrim(':');
+                if (name.empty() || !declared.insert(name).second) {
+                    continue;
+                }
+                if (auto type = types_.find(name); type != types_.end()) {
+                    EmitForwardDeclaration(os, *type->second);
+                } else if (auto enum_data = enums_.find(name); enum_data != enums_.end()) {
+                    EmitEnumForwardDeclaration(os, *enum_data->second);
+                }
+            }
+        }
+    }
+
+private:
+    static bool IsNameChar(char c) {
+        return std::isalnum(static_cast<unsigned char>(c)) || c == '_' || c == ':';
+    }
+
+    llvm::StringMap<const TypeData*> types_; // by qualified name without template arguments
+    llvm::StringMap<const EnumData*> enums_;
+};
+
+// Type spellings that appear in the shard of |reflection| outside of decltype().
+static llvm::SmallVector<llvm::StringRef, 16> ShardSpellings(const ReflectionData& reflection,
+                                                              const EmitOptions& options) {
+    llvm::SmallVector<llvm::StringRef, 16> spellings{reflection.qualified_type_name};
+    if (options.invokers) {
+        for (const auto& method : reflection.methods) {
+            spellings.append(method.param_type_list.begin(), method.param_type_list.end());
+        }
+    }
+    return spellings;
+}
+
+std::string WriteShardedOutput(llvm::StringRef directory,
+                               const ReflectionResult& result,
+                               const EmitOptions& options,
+                               uint64_t* bytes_emitted) {
+    if (auto error = llvm::sys::fs::create_directories(directory)) {
+        llvm::errs() << "cannot create output directory " << directory << ": " << error.message() << "\n";
+        return {};
+    }
+    auto path_in_directory = [&](llvm::StringRef file_name) {
+        llvm::SmallString<256> path(directory);
+        llvm::sys::path::append(path, file_name);
+        return std::string(path);
+    };
+    auto write = [&](const std::string& path, llvm::StringRef content) {
+        if (bytes_emitted) {
+            *bytes_emitted += content.size();
+        }
+        return WriteFileIfChanged(path, content);
+    };
+
+    std::string content;
+    llvm::raw_string_ostream os(content);
+    EmitPreamble(os, result, options, /*forward_declarations=*/false);
+    if (!write(path_in_directory(preamble_file_name), os.str())) {
+        return {};
+    }
+
+    ShardDeclarations declarations(result);
+    // Every header this run writes, in the order they are written.
+    std::vector<std::string> written{preamble_file_name};
+
+    std::string umbrella;
+    llvm::raw_string_ostream umbrella_os(umbrella);
+    umbrella_os << "#pragma once\n"
+                << "#include \"" << preamble_file_name << "\"\n";
+    for (const auto& [type_name, reflection] : result.reflection_table) {
+        auto file_name = ShardFileName(type_name);
+        content.clear();
+        os << "#pragma once\n"
+           << "#include \"" << preamble_file_name << "\"\n";
+        declarations.Emit(os, ShardSpellings(reflection, options));
+        EmitClassReflection(os, reflection, options);
+        if (!write(path_in_directory(file_name), os.str())) {
+            return {};
+        }
+        umbrella_os << "#include \"" << file_name << "\"\n";
+        written.push_back(file_name);
+    }
+    for (const auto& [type_name, enum_data] : result.enum_table) {
+        auto file_name = ShardFileName(type_name);
+        content.clear();
+        os << "#pragma once\n"
+           << "#include \"" << preamble_file_name << "\"\n";
+        declarations.Emit(os, enum_data.qualified_type_name);
+        EmitEnumReflection(os, enum_data);
+        if (options.json) {
+            EmitJsonEnumSerializer(os, enum_data);
+        }
+        if (!write(path_in_directory(file_name), os.str())) {
+            return {};
+        }
+        umbrella_os << "#include \"" << file_name << "\"\n";
+        written.push_back(file_name);
+    }
+
+    if (options.registry) {
+        content.clear();
+        os << "#pragma once\n"
+           << "#include \"" << preamble_file_name << "\"\n";
+        EmitRegistry(os, BuildRegistry(result));
+        if (!write(path_in_directory(registry_file_name), os.str())) {
+            return {};
+        }
+        umbrella_os << "#include \"" << registry_file_name << "\"\n";
+        written.push_back(registry_file_name);
+    }
+
+    auto umbrella_path = path_in_directory(umbrella_file_name);
+    if (!write(umbrella_path, umbrella_os.str())) {
+        return {};
+    }
+    written.push_back(umbrella_file_name);
+
+    // Headers the previous run wrote that this one did not: types that are gone, or the registry once it is no longer
+    // asked for. Nothing includes them anymore, but a stale header left behind could still be picked up by an include
+    // of its own. Files the tool did not write are never touched. Removed before the manifest is replaced, so that an
+    // interrupted run retries the removal.
+    auto manifest_path = path_in_directory(manifest_file_name);
+    llvm::StringSet<> current;
+    for (const auto& file_name : written) {
+        current.insert(file_name);
+    }
+    if (auto previous = llvm::MemoryBuffer::getFile(manifest_path)) {
+        llvm::SmallVector<llvm::StringRef, 64> lines;
+        (*previous)->getBuffer().split(lines, '\n', /*MaxSplit=*/-1, /*KeepEmpty=*/false);
+        for (auto file_name : lines) {
+            if (!current.count(file_name) && llvm::sys::path::filename(file_name) == file_name) {
+                llvm::sys::fs::remove(path_in_directory(file_name));
+            }
+        }
+    }
+    content.clear();
+    for (const auto& file_name : written) {
+        os << file_name << '\n';
+    }
+    if (!WriteFileIfChanged(manifest_path, os.str())) {
+        return {};
+    }
+    return umbrella_path;
+}
+
+// Escapes a path the way Make and Ninja expect in depfiles.
+static void WriteDepfilePath(llvm::raw_ostream& os, llvm::StringRef path) {
+    for (char c : path) {
+        if (c == ' ' || c == '#') {
+            os << '\\';
+        } else if (c == '$') {
+            os << '$';
+        }
+        os << c;
+    }
+}
+
+bool WriteDepfile(llvm::StringRef path, llvm::StringRef target, llvm::ArrayRef<std::string> dependencies) {
+    std::string content;
+    llvm::raw_string_ostream os(content);
+    WriteDepfilePath(os, target);
+    os << ':';
+    for (const auto& dependency : dependencies) {
+        os << " \\\n  ";
+        WriteDepfilePath(os, dependency);
+    }
+    os << '\n';
+    return WriteFileIfChanged(path, os.str());
+}
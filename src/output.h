@@ -0,0 +1,27 @@
+#pragma once
+
+#include <cstdint>
+#include <llvm/ADT/ArrayRef.h>
+#include <llvm/ADT/StringRef.h>
+#include <string>
+
+#include "emitter.h"
+#include "reflection_data.h"
+
+// Writes |content| to |path| unless the file already holds exactly that content, so that unchanged headers keep their
+// timestamps and do not trigger rebuilds. Returns false after reporting an error.
+bool WriteFileIfChanged(llvm::StringRef path, llvm::StringRef content);
+
+// Writes a preamble header, one header per reflected type and enum, the registry header if |options| asks for one and
+// an umbrella header including all of them into |directory|. Headers the previous run wrote and this one did not are
+// removed, as listed by a manifest kept next to them; other files in |directory| are left alone.
+// Every type header carries the forward declarations it needs, so the preamble does not change with the set of types.
+// Returns the path of the umbrella header, or an empty string after reporting an error. The size of every header,
+// written or left unchanged, is added to |bytes_emitted|.
+std::string WriteShardedOutput(llvm::StringRef directory,
+                               const ReflectionResult& result,
+                               const EmitOptions& options,
+                               uint64_t* bytes_emitted = nullptr);
+
+// Writes a Make/Ninja style depfile declaring that |target| depends on every file in |dependencies|.
+bool WriteDepfile(llvm::StringRef path, llvm::StringRef target, llvm::ArrayRef<std::string> dependencies);
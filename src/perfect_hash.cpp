@@ -0,0 +1,83 @@
+#include "perfect_hash.h"
+
+#include <algorithm>
+#include <llvm/ADT/StringSet.h>
+#include <llvm/ADT/Twine.h>
+#include <llvm/Support/ErrorHandling.h>
+#include <llvm/Support/MathExtras.h>
+#include <numeric>
+
+// Gives up on a table size after this many seeds for a single bucket and retries with twice the slots.
+constexpr uint32_t max_seed = 1u << 16;
+// Distinct names always fit long before the slots outnumber them this many times over.
+constexpr size_t max_slots_per_name = 1u << 10;
+
+static bool TryBuild(llvm::ArrayRef<llvm::StringRef> names, size_t slot_count, PerfectHashTable& table) {
+    const auto bucket_count = llvm::PowerOf2Ceil(std::max<size_t>(1, names.size() / 4));
+    std::vector<std::vector<uint32_t>> buckets(bucket_count);
+    for (uint32_t i = 0; i < names.size(); i++) {
+        buckets[NameHash(names[i], 0) & (bucket_count - 1)].push_back(i);
+    }
+    // Largest buckets first, while most slots are still free.
+    std::vector<uint32_t> order(bucket_count);
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&](uint32_t lhs, uint32_t rhs) {
+        return buckets[lhs].size() > buckets[rhs].size();
+    });
+
+    table.seeds.assign(bucket_count, 0);
+    table.slots.assign(slot_count, static_cast<uint32_t>(names.size()));
+    std::vector<size_t> bucket_slots;
+    for (auto bucket : order) {
+        if (buckets[bucket].empty()) {
+            break;
+        }
+        uint32_t seed = 1;
+        for (; seed < max_seed; seed++) {
+            bucket_slots.clear();
+            bool collision = false;
+            for (auto i : buckets[bucket]) {
+                auto slot = NameHash(names[i], seed) & (slot_count - 1);
+                if (table.slots[slot] != names.size() ||
+                    std::find(bucket_slots.begin(), bucket_slots.end(), slot) != bucket_slots.end()) {
+                    collision = true;
+                    break;
+                }
+                bucket_slots.push_back(slot);
+            }
+            if (!collision) {
+                break;
+            }
+        }
+        if (seed == max_seed) {
+            return false;
+        }
+        table.seeds[bucket] = seed;
+        for (size_t i = 0; i < bucket_slots.size(); i++) {
+            table.slots[bucket_slots[i]] = buckets[bucket][i];
+        }
+    }
+    return true;
+}
+
+PerfectHashTable BuildPerfectHash(llvm::ArrayRef<llvm::StringRef> names) {
+    llvm::StringSet<> distinct;
+    for (auto name : names) {
+        if (!distinct.insert(name).second) {
+            llvm::report_fatal_error("perfect hash over duplicate name '" + name + "'");
+        }
+    }
+    // Keep the load factor at or below 0.8, which leaves every bucket a free combination of slots within a few seeds.
+    auto slot_count = llvm::PowerOf2Ceil(std::max<size_t>(1, names.size()));
+    if (slot_count * 4 < names.size() * 5) {
+        slot_count *= 2;
+    }
+    PerfectHashTable table;
+    while (!TryBuild(names, slot_count, table)) {
+        slot_count *= 2;
+        if (slot_count > max_slots_per_name * std::max<size_t>(1, names.size())) {
+            llvm::report_fatal_error("cannot build a perfect hash over " + llvm::Twine(names.size()) + " names");
+        }
+    }
+    return table;
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <cstdint>
+#include <llvm/ADT/ArrayRef.h>
+#include <llvm/ADT/StringRef.h>
+#include <vector>
+
+// Hash of a name as computed by the generated code. Must stay in sync with reflect_name_hash() in the preamble written
+// by the emitter: FNV-1a over the bytes with the seed mixed into the offset basis, followed by a murmur finalizer.
+inline uint64_t NameHash(llvm::StringRef name, uint64_t seed) {
+    uint64_t hash = 0xcbf29ce484222325ull ^ seed;
+    for (char c : name) {
+        hash ^= static_cast<unsigned char>(c);
+        hash *= 0x100000001b3ull;
+    }
+    hash ^= hash >> 33;
+    hash *= 0xff51afd7ed558ccdull;
+    hash ^= hash >> 33;
+    return hash;
+}
+
+// Perfect hash over a fixed set of distinct names, built with hash-and-displace. A name first picks a bucket with
+// NameHash(name, 0), the bucket's seed then picks its slot with NameHash(name, seed). Both table sizes are powers of
+// two, so lookups mask instead of dividing.
+struct PerfectHashTable {
+    std::vector<uint32_t> seeds; // one per bucket
+    std::vector<uint32_t> slots; // index of the name in that slot, or the number of names for an empty slot
+};
+
+// |names| must be distinct, no table can separate two equal names. Reports a fatal error otherwise.
+PerfectHashTable BuildPerfectHash(llvm::ArrayRef<llvm::StringRef> names);
@@ -0,0 +1,124 @@
+#pragma once
+
+#include <cstdint>
+#include <llvm/ADT/ArrayRef.h>
+#include <llvm/ADT/StringRef.h>
+#include <map>
+
+namespace clang {
+class Type;
+}
+
+// Every string and list below points into the arena of interner.h: the entries are small, trivially copyable and never
+// own memory, however often a spelling repeats.
+struct TemplateParamData {
+    bool is_type = true;
+    llvm::StringRef name;
+    llvm::StringRef non_type_type_name;
+    llvm::StringRef non_type_value;
+    llvm::StringRef instantiated_type_name;
+    llvm::StringRef canonical_type_name; // the argument for type parameters, the value's type for non-type ones
+};
+struct TypeData {
+    const clang::Type* type_ptr = nullptr;
+    llvm::StringRef name;
+    llvm::StringRef qualified_name; // spelling of the canonical type
+    llvm::ArrayRef<llvm::StringRef> namespaces;
+    bool is_templated = false;
+    llvm::ArrayRef<TemplateParamData> template_params;
+};
+// Byte range inside an object.
+struct LayoutRange {
+    uint64_t offset = 0;
+    uint64_t size = 0;
+};
+// Fields of public non-virtual bases come first, ordered by the position of their base, with offsets within the
+// reflected type.
+struct FieldData {
+    llvm::StringRef name;
+    llvm::StringRef qualified_name;
+    llvm::StringRef qualified_type_name;
+    llvm::StringRef canonical_type_name;
+    // Canonical names of the class types the field stores: its own type, array elements and the type arguments of
+    // template specializations, recursively, so std::vector<name::Point> lists name::Point too.
+    llvm::ArrayRef<llvm::StringRef> stored_type_names;
+    const clang::Type* type_ptr = nullptr;
+    // Layout as computed for the target the tool was invoked for. Sizes and alignments are in bytes.
+    uint64_t offset_bits = 0;
+    uint64_t size = 0;
+    uint64_t alignment = 0;
+    bool is_bitfield = false;
+    uint64_t bit_width = 0; // only set for bit-fields
+    bool is_trivially_copyable = false;
+    // Taken from the declared type, not from its spelling.
+    bool is_const = false;
+    bool is_reference = false;
+    bool is_array = false;
+};
+struct MethodData {
+    llvm::StringRef name;
+    llvm::StringRef qualified_name;
+    llvm::StringRef qualified_return_type_name;
+    llvm::StringRef method_qualified_type_name;
+    llvm::ArrayRef<llvm::StringRef> param_type_list;
+    llvm::StringRef canonical_return_type_name;
+    llvm::ArrayRef<llvm::StringRef> canonical_param_type_list;
+    // Per parameter, taken from its declared type: whether it is an lvalue reference. Every other parameter takes its
+    // argument by value or rvalue reference, so the invoker moves the argument in.
+    llvm::ArrayRef<bool> lvalue_ref_params;
+    bool is_public = true;
+    bool is_deleted = false;
+    // Qualifiers of the implicit object parameter, which pick the overload the invoker calls.
+    bool is_const = false;
+    bool is_rvalue_ref = false;
+};
+struct ReflectionData {
+    llvm::StringRef qualified_type_name;
+    llvm::StringRef canonical_type_name; // spelled like TypeData::qualified_name, which can drop default arguments
+    llvm::ArrayRef<FieldData> fields;
+    llvm::ArrayRef<MethodData> methods;
+    const clang::Type* type_ptr = nullptr;
+    // Only meaningful when has_layout is set, which needs a complete, non-dependent definition.
+    bool has_layout = false;
+    uint64_t size = 0;
+    uint64_t alignment = 0;
+    bool is_trivially_copyable = false;
+    bool is_standard_layout = false;
+    // Storage that holds no reflected field and is no padding either, ordered by offset: inherited fields that are
+    // left out, bases that are not flattened and the vtable pointers of those that are.
+    llvm::ArrayRef<LayoutRange> opaque_ranges;
+    // Set by AssignSchemaHashes() on the merged result, never cached with a single TU's entries.
+    uint64_t schema_hash = 0;
+};
+struct EnumeratorData {
+    llvm::StringRef name;
+    int64_t value = 0; // the bits of the value, read as unsigned unless EnumData::is_signed
+};
+struct EnumData {
+    llvm::StringRef qualified_type_name;
+    llvm::StringRef canonical_type_name;
+    llvm::StringRef name;
+    llvm::ArrayRef<llvm::StringRef> namespaces;
+    llvm::StringRef underlying_type_name; // canonical spelling
+    bool is_scoped = false;
+    bool is_signed = false;
+    // Has a fixed underlying type and is declared at namespace scope, so it can be redeclared without its enumerators.
+    bool can_forward_declare = false;
+    llvm::ArrayRef<EnumeratorData> enumerators; // in declaration order, aliases included
+};
+
+// Reflection data of any number of translation units, keyed by canonical type spelling. The same type seen from
+// different TUs collapses into one entry, and iteration order does not depend on how the TUs were scheduled.
+// Type pointers inside the entries are only valid while the TU that produced them is alive.
+struct ReflectionResult {
+    std::map<llvm::StringRef, TypeData> type_infos;
+    std::map<llvm::StringRef, ReflectionData> reflection_table;
+    std::map<llvm::StringRef, EnumData> enum_table;
+};
+
+// Entries already in |into| win, so the first TU to see a type decides its data.
+inline void MergeReflectionResult(const ReflectionResult& from, ReflectionResult& into) {
+    into.type_infos.insert(from.type_infos.begin(), from.type_infos.end());
+    into.reflection_table.insert(from.reflection_table.begin(), from.reflection_table.end());
+    into.enum_table.insert(from.enum_table.begin(), from.enum_table.end());
+}
@@ -0,0 +1,377 @@
+#include "registry.h"
+
+#include <cstring>
+#include <llvm/ADT/StringMap.h>
+#include <map>
+#include <set>
+
+// Checked again by reflect_registry_from_schema() in the generated preamble.
+constexpr char schema_magic[8] = {'R', 'E', 'F', 'L', 'S', 'C', 'H', 'M'};
+constexpr uint32_t schema_version = 1;
+constexpr uint32_t schema_byte_order_mark = 0x01020304;
+
+static constexpr llvm::StringLiteral registry_preamble_helpers = R"(
+struct reflect_registry_type {
+    std::uint32_t name;
+    std::uint32_t size;
+    std::uint32_t alignment;
+    std::uint32_t flags; // record, reflected, has layout, trivially copyable, standard layout, templated from bit 0
+    std::uint32_t first_field;
+    std::uint32_t field_count;
+    std::uint32_t first_method;
+    std::uint32_t method_count;
+    std::uint32_t first_template_arg;
+    std::uint32_t template_arg_count;
+};
+
+struct reflect_registry_field {
+    std::uint32_t name;
+    std::uint32_t type;
+    std::uint32_t offset;
+    std::uint32_t flags; // bit-field at bit 0
+};
+
+struct reflect_registry_method {
+    std::uint32_t name;
+    std::uint32_t return_type;
+    std::uint32_t first_param;
+    std::uint32_t param_count;
+};
+
+struct reflect_registry_template_arg {
+    std::uint32_t flags; // type argument at bit 0
+    std::uint32_t type;
+    std::uint32_t value;
+};
+
+// Leads a schema file, followed by the tables at the given byte offsets.
+struct reflect_schema_header {
+    char magic[8];
+    std::uint32_t version;
+    std::uint32_t byte_order_mark;
+    std::uint32_t type_count;
+    std::uint32_t field_count;
+    std::uint32_t method_count;
+    std::uint32_t param_count;
+    std::uint32_t template_arg_count;
+    std::uint32_t strings_size;
+    std::uint32_t types_offset;
+    std::uint32_t fields_offset;
+    std::uint32_t methods_offset;
+    std::uint32_t params_offset;
+    std::uint32_t template_args_offset;
+    std::uint32_t strings_offset;
+};
+
+// Read-only view over registry tables, either the ones compiled into this header or a mapped schema file. Types are
+// sorted by name and a type id is an index into types.
+struct reflect_registry_view {
+    const reflect_registry_type* types = nullptr;
+    std::uint32_t type_count = 0;
+    const reflect_registry_field* fields = nullptr;
+    std::uint32_t field_count = 0;
+    const reflect_registry_method* methods = nullptr;
+    std::uint32_t method_count = 0;
+    const std::uint32_t* params = nullptr;
+    std::uint32_t param_count = 0;
+    const reflect_registry_template_arg* template_args = nullptr;
+    std::uint32_t template_arg_count = 0;
+    const char* strings = nullptr;
+    std::uint32_t strings_size = 0;
+
+    constexpr std::string_view name(std::uint32_t offset) const { return std::string_view(strings + offset); }
+
+    // Binary search by name, nullptr if the type is unknown.
+    constexpr const reflect_registry_type* find_type(std::string_view type_name) const {
+        std::uint32_t first = 0;
+        std::uint32_t last = type_count;
+        while (first < last) {
+            auto middle = first + (last - first) / 2;
+            auto middle_name = name(types[middle].name);
+            if (middle_name == type_name) {
+                return types + middle;
+            }
+            if (middle_name < type_name) {
+                first = middle + 1;
+            } else {
+                last = middle;
+            }
+        }
+        return nullptr;
+    }
+    constexpr std::uint32_t type_id(const reflect_registry_type* type) const {
+        return static_cast<std::uint32_t>(type - types);
+    }
+};
+
+// View over a schema file mapped at |data|, or an empty view if it is not a valid schema for this host. The file must
+// be mapped at least 4-byte aligned, which any mmap is.
+inline reflect_registry_view reflect_registry_from_schema(const void* data, std::size_t size) {
+    reflect_schema_header header;
+    if (size < sizeof(header)) {
+        return {};
+    }
+    std::memcpy(&header, data, sizeof(header));
+    if (std::memcmp(header.magic, "REFLSCHM", 8) != 0 || header.version != 1 || header.byte_order_mark != 0x01020304) {
+        return {};
+    }
+    auto fits = [&](std::uint32_t offset, std::uint64_t count, std::size_t element_size) {
+        return offset % alignof(std::uint32_t) == 0 && offset <= size && count * element_size <= size - offset;
+    };
+    if (!fits(header.types_offset, header.type_count, sizeof(reflect_registry_type)) ||
+        !fits(header.fields_offset, header.field_count, sizeof(reflect_registry_field)) ||
+        !fits(header.methods_offset, header.method_count, sizeof(reflect_registry_method)) ||
+        !fits(header.params_offset, header.param_count, sizeof(std::uint32_t)) ||
+        !fits(header.template_args_offset, header.template_arg_count, sizeof(reflect_registry_template_arg)) ||
+        !fits(header.strings_offset, header.strings_size, 1) || header.strings_size == 0) {
+        return {};
+    }
+    auto* bytes = static_cast<const unsigned char*>(data);
+    reflect_registry_view view;
+    view.types = reinterpret_cast<const reflect_registry_type*>(bytes + header.types_offset);
+    view.type_count = header.type_count;
+    view.fields = reinterpret_cast<const reflect_registry_field*>(bytes + header.fields_offset);
+    view.field_count = header.field_count;
+    view.methods = reinterpret_cast<const reflect_registry_method*>(bytes + header.methods_offset);
+    view.method_count = header.method_count;
+    view.params = reinterpret_cast<const std::uint32_t*>(bytes + header.params_offset);
+    view.param_count = header.param_count;
+    view.template_args = reinterpret_cast<const reflect_registry_template_arg*>(bytes + header.template_args_offset);
+    view.template_arg_count = header.template_arg_count;
+    view.strings = reinterpret_cast<const char*>(bytes + header.strings_offset);
+    view.strings_size = header.strings_size;
+    return view;
+}
+)";
+
+namespace {
+class StringTable {
+public:
+    explicit StringTable(std::string& strings)
+        : strings_(strings) {
+        Intern("");
+    }
+
+    uint32_t Intern(llvm::StringRef name) {
+        auto [it, inserted] = offsets_.try_emplace(name, static_cast<uint32_t>(strings_.size()));
+        if (inserted) {
+            strings_.append(name.begin(), name.end());
+            strings_ += '\0';
+        }
+        return it->second;
+    }
+
+private:
+    std::string& strings_;
+    llvm::StringMap<uint32_t> offsets_;
+};
+} // namespace
+
+Registry BuildRegistry(const ReflectionResult& result) {
+    std::map<llvm::StringRef, const ReflectionData*> reflections;
+    for (const auto& [type_name, reflection] : result.reflection_table) {
+        reflections.emplace(reflection.canonical_type_name, &reflection);
+    }
+
+    std::set<llvm::StringRef> type_names;
+    for (const auto& [type_name, type_data] : result.type_infos) {
+        type_names.insert(type_name);
+        for (const auto& param : type_data.template_params) {
+            type_names.insert(param.canonical_type_name);
+        }
+    }
+    for (const auto& [type_name, reflection] : reflections) {
+        type_names.insert(type_name);
+        for (const auto& field : reflection->fields) {
+            type_names.insert(field.canonical_type_name);
+        }
+        for (const auto& method : reflection->methods) {
+            type_names.insert(method.canonical_return_type_name);
+            type_names.insert(method.canonical_param_type_list.begin(), method.canonical_param_type_list.end());
+        }
+    }
+    type_names.erase("");
+    std::map<llvm::StringRef, uint32_t> type_ids;
+    for (auto type_name : type_names) {
+        type_ids.emplace(type_name, static_cast<uint32_t>(type_ids.size()));
+    }
+    auto type_id = [&](llvm::StringRef type_name) {
+        auto it = type_ids.find(type_name);
+        return it == type_ids.end() ? UINT32_MAX : it->second;
+    };
+
+    Registry registry;
+    StringTable strings(registry.strings);
+    for (auto type_name : type_names) {
+        RegistryType type;
+        type.name = strings.Intern(type_name);
+        auto type_data = result.type_infos.find(type_name);
+        if (type_data != result.type_infos.end()) {
+            type.flags |= registry_type_record;
+            if (type_data->second.is_templated) {
+                type.flags |= registry_type_templated;
+            }
+            type.first_template_arg = registry.template_args.size();
+            for (const auto& param : type_data->second.template_params) {
+                RegistryTemplateArg arg;
+                if (param.is_type) {
+                    arg.flags |= registry_template_arg_type;
+                }
+                arg.type = type_id(param.canonical_type_name);
+                arg.value = strings.Intern(param.non_type_value);
+                registry.template_args.push_back(arg);
+            }
+            type.template_arg_count = registry.template_args.size() - type.first_template_arg;
+        }
+        auto reflection_it = reflections.find(type_name);
+        if (reflection_it != reflections.end()) {
+            const auto& reflection = *reflection_it->second;
+            type.flags |= registry_type_reflected;
+            if (reflection.has_layout) {
+                type.flags |= registry_type_has_layout;
+                type.size = reflection.size;
+                type.alignment = reflection.alignment;
+            }
+            if (reflection.is_trivially_copyable) {
+                type.flags |= registry_type_trivially_copyable;
+            }
+            if (reflection.is_standard_layout) {
+                type.flags |= registry_type_standard_layout;
+            }
+            type.first_field = registry.fields.size();
+            for (const auto& field_data : reflection.fields) {
+                RegistryField field;
+                field.name = strings.Intern(field_data.name);
+                field.type = type_id(field_data.canonical_type_name);
+                field.offset = field_data.offset_bits / 8;
+                if (field_data.is_bitfield) {
+                    field.flags |= registry_field_bitfield;
+                }
+                registry.fields.push_back(field);
+            }
+            type.field_count = reflection.fields.size();
+            type.first_method = registry.methods.size();
+            for (const auto& method_data : reflection.methods) {
+                RegistryMethod method;
+                method.name = strings.Intern(method_data.name);
+                method.return_type = type_id(method_data.canonical_return_type_name);
+                method.first_param = registry.params.size();
+                for (const auto& param : method_data.canonical_param_type_list) {
+                    registry.params.push_back(type_id(param));
+                }
+                method.param_count = method_data.canonical_param_type_list.size();
+                registry.methods.push_back(method);
+            }
+            type.method_count = reflection.methods.size();
+        }
+        registry.types.push_back(type);
+    }
+    return registry;
+}
+
+void EmitRegistryPreamble(llvm::raw_ostream& os) {
+    os << registry_preamble_helpers;
+}
+
+// Writes |values| as one brace-enclosed initializer per record, given the record's members in order.
+template<typename Record, typename Members>
+static void EmitTable(llvm::raw_ostream& os,
+                      llvm::StringRef type,
+                      llvm::StringRef name,
+                      const std::vector<Record>& values,
+                      Members&& members) {
+    os << "inline constexpr std::array<" << type << ", " << values.size() << "> " << name << " = {{";
+    for (size_t i = 0; i < values.size(); i++) {
+        os << (i == 0 ? "\n    " : ",\n    ");
+        members(values[i]);
+    }
+    os << (values.empty() ? "}};\n" : "\n}};\n");
+}
+
+void EmitRegistry(llvm::raw_ostream& os, const Registry& registry) {
+    os << "// registry-begin\n";
+    // Adjacent literals keep a digit after a terminator from being read as part of an octal escape.
+    os << "inline constexpr char reflect_registry_strings[] =";
+    llvm::StringRef strings = registry.strings;
+    while (!strings.empty()) {
+        auto [name, rest] = strings.split('\0');
+        os << "\n    \"" << name << "\\0\"";
+        strings = rest;
+    }
+    os << ";\n";
+
+    EmitTable(os, "reflect_registry_type", "reflect_registry_types", registry.types, [&](const auto& type) {
+        os << '{' << type.name << ", " << type.size << ", " << type.alignment << ", " << type.flags << ", "
+           << type.first_field << ", " << type.field_count << ", " << type.first_method << ", " << type.method_count
+           << ", " << type.first_template_arg << ", " << type.template_arg_count << '}';
+    });
+    EmitTable(os, "reflect_registry_field", "reflect_registry_fields", registry.fields, [&](const auto& field) {
+        os << '{' << field.name << ", " << field.type << ", " << field.offset << ", " << field.flags << '}';
+    });
+    EmitTable(os, "reflect_registry_method", "reflect_registry_methods", registry.methods, [&](const auto& method) {
+        os << '{' << method.name << ", " << method.return_type << ", " << method.first_param << ", "
+           << method.param_count << '}';
+    });
+    EmitTable(os, "std::uint32_t", "reflect_registry_params", registry.params, [&](uint32_t param) { os << param; });
+    auto emit_template_arg = [&](const RegistryTemplateArg& arg) {
+        os << '{' << arg.flags << ", " << arg.type << ", " << arg.value << '}';
+    };
+    EmitTable(os,
+              "reflect_registry_template_arg",
+              "reflect_registry_template_args",
+              registry.template_args,
+              emit_template_arg);
+
+    os << "inline constexpr reflect_registry_view reflect_registry = {\n"
+       << "    reflect_registry_types.data(), " << registry.types.size() << ",\n"
+       << "    reflect_registry_fields.data(), " << registry.fields.size() << ",\n"
+       << "    reflect_registry_methods.data(), " << registry.methods.size() << ",\n"
+       << "    reflect_registry_params.data(), " << registry.params.size() << ",\n"
+       << "    reflect_registry_template_args.data(), " << registry.template_args.size() << ",\n"
+       << "    reflect_registry_strings, " << registry.strings.size() << ",\n"
+       << "};\n";
+    os << "// registry-end\n";
+}
+
+template<typename Record>
+static void AppendRecords(std::string& out, const std::vector<Record>& records, uint32_t& offset, uint32_t& count) {
+    offset = out.size();
+    count = records.size();
+    out.append(reinterpret_cast<const char*>(records.data()), records.size() * sizeof(Record));
+}
+
+std::string SerializeRegistry(const Registry& registry) {
+    // Same layout as reflect_schema_header; every table is made of 32-bit values in host byte order.
+    struct Header {
+        char magic[8];
+        uint32_t version;
+        uint32_t byte_order_mark;
+        uint32_t type_count;
+        uint32_t field_count;
+        uint32_t method_count;
+        uint32_t param_count;
+        uint32_t template_arg_count;
+        uint32_t strings_size;
+        uint32_t types_offset;
+        uint32_t fields_offset;
+        uint32_t methods_offset;
+        uint32_t params_offset;
+        uint32_t template_args_offset;
+        uint32_t strings_offset;
+    } header;
+    std::memcpy(header.magic, schema_magic, sizeof(header.magic));
+    header.version = schema_version;
+    header.byte_order_mark = schema_byte_order_mark;
+
+    std::string out(sizeof(Header), '\0');
+    AppendRecords(out, registry.types, header.types_offset, header.type_count);
+    AppendRecords(out, registry.fields, header.fields_offset, header.field_count);
+    AppendRecords(out, registry.methods, header.methods_offset, header.method_count);
+    AppendRecords(out, registry.params, header.params_offset, header.param_count);
+    AppendRecords(out, registry.template_args, header.template_args_offset, header.template_arg_count);
+    header.strings_offset = out.size();
+    header.strings_size = registry.strings.size();
+    out += registry.strings;
+    std::memcpy(&out[0], &header, sizeof(header));
+    return out;
+}
@@ -0,0 +1,84 @@
+#pragma once
+
+#include <cstdint>
+#include <llvm/Support/raw_ostream.h>
+#include <string>
+#include <vector>
+
+#include "reflection_data.h"
+
+// Flat runtime type registry. Every table holds fixed size records of 32-bit values that refer to each other by index
+// and to names by offset into one string blob, so the tables can be placed in read-only data as they are or written
+// to a schema file and mapped. The records mirror reflect_registry_* in the generated preamble.
+
+// Bits of RegistryType::flags.
+enum RegistryTypeFlags : uint32_t {
+    registry_type_record = 1u << 0,
+    registry_type_reflected = 1u << 1, // has fields and methods
+    registry_type_has_layout = 1u << 2,
+    registry_type_trivially_copyable = 1u << 3,
+    registry_type_standard_layout = 1u << 4,
+    registry_type_templated = 1u << 5,
+};
+
+// Bits of RegistryField::flags and RegistryTemplateArg::flags.
+enum RegistryMemberFlags : uint32_t {
+    registry_field_bitfield = 1u << 0,
+    registry_template_arg_type = 1u << 0,
+};
+
+// A type id is the index of the type in Registry::types, which is sorted by name.
+struct RegistryType {
+    uint32_t name = 0;
+    uint32_t size = 0;
+    uint32_t alignment = 0;
+    uint32_t flags = 0;
+    uint32_t first_field = 0;
+    uint32_t field_count = 0;
+    uint32_t first_method = 0;
+    uint32_t method_count = 0;
+    uint32_t first_template_arg = 0;
+    uint32_t template_arg_count = 0;
+};
+
+struct RegistryField {
+    uint32_t name = 0;
+    uint32_t type = 0;
+    uint32_t offset = 0; // bytes, the byte holding the first bit for bit-fields
+    uint32_t flags = 0;
+};
+
+struct RegistryMethod {
+    uint32_t name = 0;
+    uint32_t return_type = 0;
+    uint32_t first_param = 0; // into Registry::params, which holds type ids
+    uint32_t param_count = 0;
+};
+
+struct RegistryTemplateArg {
+    uint32_t flags = 0;
+    uint32_t type = 0;  // the argument for type parameters, the value's type otherwise
+    uint32_t value = 0; // name of the value for non-type parameters, empty if it is not integral
+};
+
+struct Registry {
+    std::vector<RegistryType> types;
+    std::vector<RegistryField> fields;
+    std::vector<RegistryMethod> methods;
+    std::vector<uint32_t> params;
+    std::vector<RegistryTemplateArg> template_args;
+    std::string strings; // null terminated names, starting with the empty name at offset 0
+};
+
+// Every type known to |result|, including the non-record types of fields, parameters and template arguments, which
+// are keyed by their canonical spelling.
+Registry BuildRegistry(const ReflectionResult& result);
+
+// reflect_registry_* record types, reflect_registry_view and the schema file header.
+void EmitRegistryPreamble(llvm::raw_ostream& os);
+
+// The tables of |registry| as constexpr arrays, and the reflect_registry view over them.
+void EmitRegistry(llvm::raw_ostream& os, const Registry& registry);
+
+// Content of a schema file holding |registry|, readable with reflect_registry_from_schema().
+std::string SerializeRegistry(const Registry& registry);
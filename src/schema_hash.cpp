@@ -0,0 +1,63 @@
+#include "schema_hash.h"
+
+#include <llvm/ADT/StringMap.h>
+#include <llvm/Support/Format.h>
+
+#include "perfect_hash.h"
+
+namespace {
+
+class SchemaHasher {
+public:
+    // Fields spell the types they store canonically, while the reflection table is keyed by the spelling the user
+    // wrote, so nested types are looked up by canonical name.
+    explicit SchemaHasher(ReflectionResult& result) {
+        for (auto& [type_name, reflection] : result.reflection_table) {
+            reflections_.try_emplace(reflection.canonical_type_name, &reflection);
+        }
+    }
+
+    uint64_t Hash(ReflectionData& reflection) {
+        auto [it, inserted] = state_.try_emplace(reflection.canonical_type_name, State::InProgress);
+        if (!inserted) {
+            // Types cannot contain themselves by value, a cycle only shows up with inconsistent entries. It hashes
+            // like a field of a type that is not reflected.
+            return it->second == State::Done ? reflection.schema_hash : 0;
+        }
+        uint64_t hash = NameHash("reflect-schema-v1", reflection.fields.size());
+        for (const auto& field : reflection.fields) {
+            hash = NameHash(field.name, hash);
+            hash = NameHash(field.canonical_type_name, hash);
+            hash = NameHash(field.is_bitfield ? "bitfield" : "", hash ^ field.bit_width);
+            for (auto stored_type_name : field.stored_type_names) {
+                auto nested = reflections_.find(stored_type_name);
+                if (nested != reflections_.end()) {
+                    hash = NameHash("nested", hash ^ Hash(*nested->second));
+                }
+            }
+        }
+        reflection.schema_hash = hash;
+        state_[reflection.canonical_type_name] = State::Done;
+        return hash;
+    }
+
+private:
+    enum class State { InProgress, Done };
+    llvm::StringMap<ReflectionData*> reflections_;
+    llvm::StringMap<State> state_;
+};
+
+} // namespace
+
+void AssignSchemaHashes(ReflectionResult& result) {
+    SchemaHasher hasher(result);
+    for (auto& [type_name, reflection] : result.reflection_table) {
+        hasher.Hash(reflection);
+    }
+}
+
+void WriteSchemaHashManifest(llvm::raw_ostream& os, const ReflectionResult& result) {
+    for (const auto& [type_name, reflection] : result.reflection_table) {
+        os << llvm::format_hex_no_prefix(reflection.schema_hash, 16) << ' ' << reflection.qualified_type_name << '\n';
+    }
+}
@@ -0,0 +1,17 @@
+#pragma once
+
+#include <llvm/Support/raw_ostream.h>
+
+#include "reflection_data.h"
+
+// Schema hash of every reflected type: a 64-bit digest of its fields' names, canonical types and bit-field widths in
+// declaration order, where every reflected type a field stores (by value, as array elements or as a template argument
+// such as the element type of std::vector) also contributes its own schema hash. Methods, the type's own name and
+// offsets, sizes and padding do not take part, so the hash of a type only changes when what is stored in it does. Types
+// are hashed as the target spells them canonically, so hashes are only comparable between builds for targets that agree
+// on those spellings: std::int64_t is long on LP64 Linux and long long on Windows and macOS. Must run on the merged
+// result, a type's hash depends on the entries of the types nested in it.
+void AssignSchemaHashes(ReflectionResult& result);
+
+// One "<hash> <type name>" line per reflected type, ordered by type name, for comparing schemas between builds.
+void WriteSchemaHashManifest(llvm::raw_ostream& os, const ReflectionResult& result);
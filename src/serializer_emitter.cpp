@@ -0,0 +1,217 @@
+#include "serializer_emitter.h"
+
+#include "layout.h"
+
+static constexpr llvm::StringLiteral serializer_preamble_helpers = R"(
+// Appends bytes in host byte order.
+struct binary_writer {
+    std::vector<unsigned char>& out;
+
+    void write(const void* data, std::size_t size) {
+        auto offset = out.size();
+        out.resize(offset + size);
+        std::memcpy(out.data() + offset, data, size);
+    }
+};
+
+// Reads straight out of a caller-provided buffer, which has to outlive the reader.
+struct binary_reader {
+    const unsigned char* data;
+    std::size_t size;
+    std::size_t position = 0;
+
+    bool read(void* destination, std::size_t count) {
+        if (size - position < count) {
+            return false;
+        }
+        std::memcpy(destination, data + position, count);
+        position += count;
+        return true;
+    }
+};
+
+template<typename T, typename Enable = void>
+struct binary_serializer {
+    static_assert(std::is_trivially_copyable<T>::value,
+                  "binary_serializer needs a trivially copyable, reflected or specialized type");
+    static void write(binary_writer& writer, const T& value) { writer.write(&value, sizeof(T)); }
+    static bool read(binary_reader& reader, T& value) { return reader.read(&value, sizeof(T)); }
+};
+
+template<typename C, typename Traits, typename Allocator>
+struct binary_serializer<std::basic_string<C, Traits, Allocator>> {
+    static void write(binary_writer& writer, const std::basic_string<C, Traits, Allocator>& value) {
+        std::uint64_t size = value.size();
+        writer.write(&size, sizeof(size));
+        writer.write(value.data(), value.size() * sizeof(C));
+    }
+    static bool read(binary_reader& reader, std::basic_string<C, Traits, Allocator>& value) {
+        std::uint64_t size = 0;
+        if (!reader.read(&size, sizeof(size)) || (reader.size - reader.position) / sizeof(C) < size) {
+            return false;
+        }
+        value.resize(static_cast<std::size_t>(size));
+        return reader.read(&value[0], value.size() * sizeof(C));
+    }
+};
+
+// Vectors of trivially copyable elements are copied in bulk, others element by element.
+template<typename V, typename Allocator>
+struct binary_serializer<std::vector<V, Allocator>> {
+    static constexpr bool bulk = std::is_trivially_copyable<V>::value && !std::is_same<V, bool>::value;
+
+    static void write(binary_writer& writer, const std::vector<V, Allocator>& value) {
+        std::uint64_t size = value.size();
+        writer.write(&size, sizeof(size));
+        if constexpr (bulk) {
+            writer.write(value.data(), value.size() * sizeof(V));
+        } else {
+            for (const V& element : value) {
+                binary_serializer<V>::write(writer, element);
+            }
+        }
+    }
+    static bool read(binary_reader& reader, std::vector<V, Allocator>& value) {
+        std::uint64_t size = 0;
+        if (!reader.read(&size, sizeof(size))) {
+            return false;
+        }
+        value.clear();
+        if constexpr (bulk) {
+            if ((reader.size - reader.position) / sizeof(V) < size) {
+                return false;
+            }
+            value.resize(static_cast<std::size_t>(size));
+            return reader.read(value.data(), value.size() * sizeof(V));
+        } else {
+            for (std::uint64_t i = 0; i < size; i++) {
+                V element{};
+                if (!binary_serializer<V>::read(reader, element)) {
+                    return false;
+                }
+                value.push_back(std::move(element));
+            }
+            return true;
+        }
+    }
+};
+
+template<typename T>
+void serialize(const T& value, std::vector<unsigned char>& out) {
+    binary_writer writer{out};
+    binary_serializer<T>::write(writer, value);
+}
+
+// Returns the number of bytes consumed from |data|, or 0 if it does not hold a complete T.
+template<typename T>
+std::size_t deserialize(const unsigned char* data, std::size_t size, T& value) {
+    binary_reader reader{data, size};
+    return binary_serializer<T>::read(reader, value) ? reader.position : 0;
+}
+)";
+
+// read() assigns every field, which a reference cannot be reseated by and a const field cannot take, neither by value
+// nor by a memcpy over its run.
+static bool SupportsSerializer(const ReflectionData& reflection) {
+    for (const auto& field : reflection.fields) {
+        if (field.is_const || field.is_reference) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void EmitSerializerPreamble(llvm::raw_ostream& os) {
+    os << serializer_preamble_helpers;
+}
+
+void EmitSerializer(llvm::raw_ostream& os, const ReflectionData& reflection) {
+    if (!SupportsSerializer(reflection)) {
+        return;
+    }
+    const auto& fields = reflection.fields;
+    auto runs = ComputeCopyRuns(reflection);
+
+    // Each step is either a copy run or a single field, in declaration order.
+    struct Step {
+        const CopyRun* run = nullptr;
+        size_t field = 0;
+    };
+    std::vector<Step> steps;
+    for (size_t i = 0, next_run = 0; i < fields.size();) {
+        if (next_run < runs.size() && runs[next_run].first_field == i) {
+            steps.push_back({&runs[next_run], i});
+            i += runs[next_run].field_count;
+            next_run++;
+        } else {
+            steps.push_back({nullptr, i});
+            i++;
+        }
+    }
+
+    os << "\ntemplate <typename T> struct binary_serializer<T, typename std::enable_if<std::is_same<T, "
+       << reflection.qualified_type_name << ">::value, void >::type> {\n";
+    if (!runs.empty()) {
+        os << "    static_assert(sizeof(T) == " << reflection.size << ", \"layout of " << reflection.qualified_type_name
+           << " differs from the reflected one\");\n";
+    }
+
+    auto emit_run_comment = [&](const CopyRun& run) {
+        os << " // " << fields[run.first_field].name;
+        if (run.field_count > 1) {
+            os << " .. " << fields[run.first_field + run.field_count - 1].name;
+        }
+        os << '\n';
+    };
+
+    os << "    static void write(binary_writer& writer, const T& value) {\n";
+    if (!runs.empty()) {
+        os << "        const auto* bytes = reinterpret_cast<const unsigned char*>(&value);\n";
+    }
+    for (const auto& step : steps) {
+        if (step.run) {
+            os << "        writer.write(bytes + " << step.run->offset << ", " << step.run->size << ");";
+            emit_run_comment(*step.run);
+            continue;
+        }
+        const auto& name = fields[step.field].name;
+        os << "        binary_serializer<decltype(T::" << name << ")>::write(writer, value." << name << ");\n";
+    }
+    if (fields.empty()) {
+        os << "        (void)writer;\n"
+              "        (void)value;\n";
+    }
+    os << "    }\n";
+
+    os << "    static bool read(binary_reader& reader, T& value) {\n";
+    if (!runs.empty()) {
+        os << "        auto* bytes = reinterpret_cast<unsigned char*>(&value);\n";
+    }
+    for (const auto& step : steps) {
+        if (step.run) {
+            os << "        if (!reader.read(bytes + " << step.run->offset << ", " << step.run->size
+               << ")) { return false; }";
+            emit_run_comment(*step.run);
+            continue;
+        }
+        const auto& field = fields[step.field];
+        if (field.is_bitfield) {
+            os << "        {\n"
+               << "            decltype(T::" << field.name << ") field{};\n"
+               << "            if (!binary_serializer<decltype(T::" << field.name
+               << ")>::read(reader, field)) { return false; }\n"
+               << "            value." << field.name << " = field;\n"
+               << "        }\n";
+            continue;
+        }
+        os << "        if (!binary_serializer<decltype(T::" << field.name << ")>::read(reader, value." << field.name
+           << ")) { return false; }\n";
+    }
+    if (fields.empty()) {
+        os << "        (void)reader;\n"
+              "        (void)value;\n";
+    }
+    os << "        return true;\n"
+          "    }\n"
+          "};\n";
+}
@@ -0,0 +1,16 @@
+#pragma once
+
+#include <llvm/Support/raw_ostream.h>
+
+#include "reflection_data.h"
+
+// Writers for the binary serializers generated with --serializer.
+
+// binary_writer/binary_reader, the primary binary_serializer for trivially copyable types, the std::string and
+// std::vector specializations and the serialize()/deserialize() entry points.
+void EmitSerializerPreamble(llvm::raw_ostream& os);
+
+// binary_serializer<T> for |reflection|. Runs of contiguous trivially copyable fields are written and read with a
+// single copy each, every other field goes through the binary_serializer of its own type. Types with reference or
+// const members get none, since deserialize() could not assign them.
+void EmitSerializer(llvm::raw_ostream& os, const ReflectionData& reflection);
@@ -0,0 +1,279 @@
+#include "server.h"
+
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <llvm/ADT/SmallString.h>
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/Path.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <sys/inotify.h>
+#endif
+
+FileWatcher::FileWatcher() {
+#ifdef __linux__
+    inotify_fd_ = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+#endif
+}
+
+FileWatcher::~FileWatcher() {
+    if (inotify_fd_ >= 0) {
+        close(inotify_fd_);
+    }
+}
+
+FileWatcher::Stamp FileWatcher::StampOf(llvm::StringRef path) {
+    Stamp stamp;
+    llvm::sys::fs::file_status status;
+    if (!llvm::sys::fs::status(path, status)) {
+        stamp.modification_time = status.getLastModificationTime().time_since_epoch().count();
+        stamp.size = status.getSize();
+        stamp.exists = true;
+    }
+    return stamp;
+}
+
+void FileWatcher::Watch(llvm::StringRef path, llvm::sys::TimePoint<> read_since) {
+    auto inserted = files_.try_emplace(path, StampOf(path));
+    if (!inserted.second) {
+        return;
+    }
+    // File systems stamp with a coarse clock that can trail the system clock, so recent stamps count as changes.
+    const auto& stamp = inserted.first->getValue();
+    auto slack = std::chrono::duration_cast<llvm::sys::TimePoint<>::duration>(std::chrono::seconds(1));
+    if (!stamp.exists || stamp.modification_time >= (read_since - slack).time_since_epoch().count()) {
+        changes_.insert(path);
+    }
+#ifdef __linux__
+    auto directory = llvm::sys::path::parent_path(path);
+    if (inotify_fd_ < 0 || !watched_directories_.insert(directory).second) {
+        return;
+    }
+    int watch = inotify_add_watch(inotify_fd_,
+                                  std::string(directory).c_str(),
+                                  IN_CLOSE_WRITE | IN_MODIFY | IN_MOVED_TO | IN_CREATE | IN_DELETE | IN_ATTRIB);
+    if (watch >= 0) {
+        directories_[watch] = std::string(directory);
+    }
+#endif
+}
+
+void FileWatcher::ReadEvents() {
+#ifdef __linux__
+    if (inotify_fd_ < 0) {
+        return;
+    }
+    alignas(inotify_event) char buffer[16 * 1024];
+    while (true) {
+        auto length = read(inotify_fd_, buffer, sizeof(buffer));
+        if (length <= 0) {
+            return; // EAGAIN once the queue is drained
+        }
+        for (char* p = buffer; p < buffer + length;) {
+            auto* event = reinterpret_cast<inotify_event*>(p);
+            p += sizeof(inotify_event) + event->len;
+            if (event->mask & IN_Q_OVERFLOW) {
+                // Events were lost, anything may have changed.
+                for (const auto& file : files_) {
+                    changes_.insert(file.getKey());
+                }
+                continue;
+            }
+            auto directory = directories_.find(event->wd);
+            if (directory == directories_.end() || event->len == 0) {
+                continue;
+            }
+            llvm::SmallString<256> path(directory->second);
+            llvm::sys::path::append(path, event->name);
+            if (files_.count(path)) {
+                changes_.insert(path);
+            }
+        }
+    }
+#endif
+}
+
+std::vector<std::string> FileWatcher::TakeChanges() {
+    if (inotify_fd_ >= 0) {
+        ReadEvents();
+    } else {
+        for (auto& file : files_) {
+            auto stamp = StampOf(file.getKey());
+            if (stamp.exists != file.getValue().exists || stamp.size != file.getValue().size ||
+                stamp.modification_time != file.getValue().modification_time) {
+                changes_.insert(file.getKey());
+            }
+        }
+    }
+    std::vector<std::string> changes;
+    for (const auto& change : changes_) {
+        auto path = change.getKey();
+        changes.emplace_back(path);
+        files_[path] = StampOf(path);
+    }
+    changes_.clear();
+    return changes;
+}
+
+static bool MakeAddress(llvm::StringRef socket_path, sockaddr_un& address) {
+    std::memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (socket_path.size() >= sizeof(address.sun_path)) {
+        llvm::errs() << "socket path " << socket_path << " is too long\n";
+        return false;
+    }
+    std::memcpy(address.sun_path, socket_path.data(), socket_path.size());
+    return true;
+}
+
+static int Connect(const sockaddr_un& address) {
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        return -1;
+    }
+    if (connect(fd, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0) {
+        int error = errno;
+        close(fd);
+        errno = error;
+        return -1;
+    }
+    return fd;
+}
+
+static bool WriteAll(int fd, llvm::StringRef data) {
+    while (!data.empty()) {
+        auto written = write(fd, data.data(), data.size());
+        if (written < 0 && errno == EINTR) {
+            continue;
+        }
+        if (written <= 0) {
+            return false;
+        }
+        data = data.drop_front(written);
+    }
+    return true;
+}
+
+static std::string ReadLine(int fd) {
+    std::string line;
+    char c;
+    while (read(fd, &c, 1) == 1 && c != '\n') {
+        line += c;
+    }
+    return line;
+}
+
+bool ServeRequests(llvm::StringRef socket_path,
+                   FileWatcher& watcher,
+                   llvm::function_ref<int(llvm::StringRef request, llvm::raw_ostream& reply)> handle) {
+    sockaddr_un address;
+    if (!MakeAddress(socket_path, address)) {
+        return false;
+    }
+    // A socket file nobody listens on is left over from a server that died; one that answers belongs to a live server.
+    if (int fd = Connect(address); fd >= 0) {
+        close(fd);
+        llvm::errs() << "a server is already listening on " << socket_path << "\n";
+        return false;
+    }
+    unlink(address.sun_path);
+
+    int listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (listen_fd < 0 || bind(listen_fd, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0 ||
+        listen(listen_fd, 16) != 0) {
+        llvm::errs() << "cannot listen on " << socket_path << ": " << std::strerror(errno) << "\n";
+        if (listen_fd >= 0) {
+            close(listen_fd);
+        }
+        return false;
+    }
+    // A client that goes away before reading its reply must not take the server down.
+    std::signal(SIGPIPE, SIG_IGN);
+
+    bool running = true;
+    while (running) {
+        pollfd fds[2] = {{listen_fd, POLLIN, 0}, {watcher.fd(), POLLIN, 0}};
+        int fd_count = watcher.fd() >= 0 ? 2 : 1;
+        if (poll(fds, fd_count, -1) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            llvm::errs() << "poll failed: " << std::strerror(errno) << "\n";
+            break;
+        }
+        if (fd_count == 2 && (fds[1].revents & POLLIN)) {
+            watcher.ReadEvents();
+        }
+        if (!(fds[0].revents & POLLIN)) {
+            continue;
+        }
+        int client = accept(listen_fd, nullptr, nullptr);
+        if (client < 0) {
+            continue;
+        }
+        auto request = ReadLine(client);
+        std::string reply;
+        llvm::raw_string_ostream reply_os(reply);
+        int status = 0;
+        if (request == "shutdown") {
+            running = false;
+        } else {
+            status = handle(request, reply_os);
+        }
+        reply_os << "exit " << status << "\n";
+        WriteAll(client, reply_os.str());
+        close(client);
+    }
+    close(listen_fd);
+    unlink(address.sun_path);
+    return true;
+}
+
+int RunClient(llvm::StringRef socket_path, llvm::StringRef request) {
+    sockaddr_un address;
+    if (!MakeAddress(socket_path, address)) {
+        return 1;
+    }
+    int fd = Connect(address);
+    if (fd < 0) {
+        llvm::errs() << "cannot connect to " << socket_path << ": " << std::strerror(errno) << "\n";
+        return 1;
+    }
+    if (!WriteAll(fd, (request + "\n").str())) {
+        llvm::errs() << "cannot send request to " << socket_path << "\n";
+        close(fd);
+        return 1;
+    }
+    std::string reply;
+    char buffer[4096];
+    ssize_t length;
+    while ((length = read(fd, buffer, sizeof(buffer))) > 0 || (length < 0 && errno == EINTR)) {
+        if (length > 0) {
+            reply.append(buffer, length);
+        }
+    }
+    close(fd);
+
+    // Everything before the final status line is for the user.
+    llvm::StringRef body = llvm::StringRef(reply).rtrim('\n');
+    auto [text, status_line] = body.rsplit('\n');
+    if (!status_line.startswith("exit ")) {
+        std::swap(text, status_line);
+        if (!status_line.startswith("exit ")) {
+            llvm::errs() << "server closed the connection without a status\n";
+            return 1;
+        }
+        text = {};
+    }
+    if (!text.empty()) {
+        llvm::errs() << text << "\n";
+    }
+    int status = 1;
+    status_line.drop_front(5).getAsInteger(10, status);
+    return status;
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <llvm/ADT/DenseMap.h>
+#include <llvm/ADT/STLFunctionalExtras.h>
+#include <llvm/ADT/StringMap.h>
+#include <llvm/ADT/StringRef.h>
+#include <llvm/ADT/StringSet.h>
+#include <llvm/Support/Chrono.h>
+#include <llvm/Support/raw_ostream.h>
+#include <string>
+#include <vector>
+
+// Collects the files among the watched ones that changed since the last TakeChanges(). On Linux this uses inotify on
+// the parent directories, so that files an editor replaces by renaming over them are seen as well. Elsewhere the
+// watched files are stat()ed when changes are asked for.
+class FileWatcher {
+public:
+    FileWatcher();
+    ~FileWatcher();
+    FileWatcher(const FileWatcher&) = delete;
+    FileWatcher& operator=(const FileWatcher&) = delete;
+
+    // |path| must be absolute and was read at or after |read_since|. A file first watched after it was modified past
+    // that point is reported as changed right away, as the reader may have seen either version. Watching a file twice
+    // is harmless.
+    void Watch(llvm::StringRef path, llvm::sys::TimePoint<> read_since);
+
+    // Descriptor that becomes readable when there are events to read, or -1 without inotify.
+    int fd() const {
+        return inotify_fd_;
+    }
+
+    // Reads the pending events without blocking. Called whenever fd() is readable, so the kernel queue never overflows.
+    void ReadEvents();
+
+    // Paths of the watched files that changed, each reported once.
+    std::vector<std::string> TakeChanges();
+
+private:
+    struct Stamp {
+        int64_t modification_time = 0;
+        uint64_t size = 0;
+        bool exists = false;
+    };
+    static Stamp StampOf(llvm::StringRef path);
+
+    int inotify_fd_ = -1;
+    llvm::DenseMap<int, std::string> directories_; // watch descriptor -> directory
+    llvm::StringSet<> watched_directories_;
+    llvm::StringMap<Stamp> files_;
+    llvm::StringSet<> changes_;
+};
+
+// Accepts connections on a Unix domain socket at |socket_path| until a "shutdown" request arrives. Every connection
+// sends one request line and is answered with whatever |handle| writes, followed by a final "exit <status>" line
+// carrying the status |handle| returned. Events of |watcher| are read while waiting. Returns false after reporting an
+// error if the socket cannot be set up.
+bool ServeRequests(llvm::StringRef socket_path,
+                   FileWatcher& watcher,
+                   llvm::function_ref<int(llvm::StringRef request, llvm::raw_ostream& reply)> handle);
+
+// Sends |request| to the server at |socket_path|, copies the reply to stderr and returns the server's exit status, or
+// 1 if the server cannot be reached.
+int RunClient(llvm::StringRef socket_path, llvm::StringRef request);
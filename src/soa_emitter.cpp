@@ -0,0 +1,233 @@
+#include "soa_emitter.h"
+
+static constexpr llvm::StringLiteral soa_preamble_helpers = R"(
+template<typename V>
+struct soa_span {
+    V* data_ = nullptr;
+    std::size_t size_ = 0;
+
+    V* data() const { return data_; }
+    std::size_t size() const { return size_; }
+    bool empty() const { return size_ == 0; }
+    V* begin() const { return data_; }
+    V* end() const { return data_ + size_; }
+    V& operator[](std::size_t i) const { return data_[i]; }
+};
+
+// Growable contiguous storage for one column. Unlike std::vector it has no bool specialization, so every column can
+// hand out plain pointers and references. Like std::vector, only the first size() elements are constructed, so V needs
+// no default constructor.
+template<typename V>
+class soa_column {
+public:
+    soa_column() = default;
+    soa_column(const soa_column& other) {
+        reserve(other.size_);
+        std::uninitialized_copy(other.data_, other.data_ + other.size_, data_);
+        size_ = other.size_;
+    }
+    soa_column(soa_column&& other) noexcept
+        : data_(std::exchange(other.data_, nullptr))
+        , size_(std::exchange(other.size_, 0))
+        , capacity_(std::exchange(other.capacity_, 0)) {}
+    soa_column& operator=(soa_column other) noexcept {
+        std::swap(data_, other.data_);
+        std::swap(size_, other.size_);
+        std::swap(capacity_, other.capacity_);
+        return *this;
+    }
+    ~soa_column() {
+        clear();
+        if (data_) {
+            std::allocator<V>().deallocate(data_, capacity_);
+        }
+    }
+
+    V* data() { return data_; }
+    const V* data() const { return data_; }
+    std::size_t size() const { return size_; }
+    std::size_t capacity() const { return capacity_; }
+    V& operator[](std::size_t i) { return data_[i]; }
+    const V& operator[](std::size_t i) const { return data_[i]; }
+
+    void reserve(std::size_t capacity) {
+        if (capacity <= capacity_) {
+            return;
+        }
+        V* data = std::allocator<V>().allocate(capacity);
+        if (data_) {
+            std::uninitialized_move(data_, data_ + size_, data);
+            std::destroy(data_, data_ + size_);
+            std::allocator<V>().deallocate(data_, capacity_);
+        }
+        data_ = data;
+        capacity_ = capacity;
+    }
+    void push_back(const V& value) {
+        if (size_ == capacity_) {
+            V copy = value; // |value| may live in the storage about to be released
+            reserve(capacity_ ? capacity_ * 2 : 8);
+            ::new (static_cast<void*>(data_ + size_)) V(std::move(copy));
+        } else {
+            ::new (static_cast<void*>(data_ + size_)) V(value);
+        }
+        ++size_;
+    }
+    void pop_back() { data_[--size_].~V(); }
+    void clear() {
+        std::destroy(data_, data_ + size_);
+        size_ = 0;
+    }
+
+private:
+    V* data_ = nullptr;
+    std::size_t size_ = 0;
+    std::size_t capacity_ = 0;
+};
+
+template<typename T, typename Enable = void>
+class soa_vector;
+)";
+
+static bool SupportsSoa(const ReflectionData& reflection) {
+    if (reflection.fields.empty()) {
+        return false;
+    }
+    for (const auto& field : reflection.fields) {
+        if (field.is_bitfield || field.is_const || field.is_reference || field.is_array) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void EmitSoaPreamble(llvm::raw_ostream& os) {
+    os << soa_preamble_helpers;
+}
+
+void EmitSoaVector(llvm::raw_ostream& os, const ReflectionData& reflection) {
+    if (!SupportsSoa(reflection)) {
+        return;
+    }
+    const auto& fields = reflection.fields;
+    auto for_each_column = [&](llvm::StringRef indent, auto&& emit) {
+        for (size_t i = 0; i < fields.size(); i++) {
+            os << indent;
+            emit(i, fields[i].name);
+            os << '\n';
+        }
+    };
+
+    os << "\ntemplate <typename T> class soa_vector<T, typename std::enable_if<std::is_same<T, "
+       << reflection.qualified_type_name << ">::value, void >::type> {\n"
+       << "public:\n";
+    os << "    // Row proxies, one reference per field.\n"
+          "    struct reference {\n";
+    for_each_column("        ", [&](size_t, llvm::StringRef name) {
+        os << "decltype(T::" << name << ")& " << name << ';';
+    });
+    os << "    };\n"
+          "    struct const_reference {\n";
+    for_each_column("        ", [&](size_t, llvm::StringRef name) {
+        os << "const decltype(T::" << name << ")& " << name << ';';
+    });
+    os << "    };\n\n";
+
+    os << "    soa_vector() = default;\n"
+          "    soa_vector(const T* first, const T* last) {\n"
+          "        reserve(static_cast<std::size_t>(last - first));\n"
+          "        for (; first != last; ++first) {\n"
+          "            push_back(*first);\n"
+          "        }\n"
+          "    }\n\n";
+
+    os << "    std::size_t size() const { return column_0_.size(); }\n"
+          "    bool empty() const { return column_0_.size() == 0; }\n";
+    os << "    void reserve(std::size_t capacity) {\n";
+    for_each_column("        ", [&](size_t i, llvm::StringRef) { os << "column_" << i << "_.reserve(capacity);"; });
+    os << "    }\n"
+          "    void clear() {\n";
+    for_each_column("        ", [&](size_t i, llvm::StringRef) { os << "column_" << i << "_.clear();"; });
+    os << "    }\n"
+          "    // Every column grows before anything is copied, and a copy that throws takes the copies before it back out, so\n"
+          "    // all columns keep size() elements.\n"
+          "    void push_back(const T& value) {\n"
+          "        if (size() == column_0_.capacity()) {\n"
+          "            reserve(size() ? size() * 2 : 8);\n"
+          "        }\n"
+          "        struct rollback {\n"
+          "            soa_vector* self;\n"
+          "            std::size_t pushed;\n"
+          "            ~rollback() { self->pop_columns(pushed); }\n"
+          "        } guard{this, 0};\n";
+    for_each_column("        ", [&](size_t i, llvm::StringRef name) {
+        os << "column_" << i << "_.push_back(value." << name << ");\n"
+           << "        guard.pushed++;";
+    });
+    os << "        guard.pushed = 0;\n"
+          "    }\n"
+          "    void pop_back() {\n";
+    for_each_column("        ", [&](size_t i, llvm::StringRef) { os << "column_" << i << "_.pop_back();"; });
+    os << "    }\n\n";
+
+    os << "    reference operator[](std::size_t i) { return {";
+    for (size_t i = 0; i < fields.size(); i++) {
+        os << (i == 0 ? " " : ", ") << "column_" << i << "_[i]";
+    }
+    os << " }; }\n"
+          "    const_reference operator[](std::size_t i) const { return {";
+    for (size_t i = 0; i < fields.size(); i++) {
+        os << (i == 0 ? " " : ", ") << "column_" << i << "_[i]";
+    }
+    os << " }; }\n";
+
+    os << "    // Gathers row |i| back into a T, which needs T to be default-constructible.\n"
+          "    template <typename U = T, typename = std::enable_if_t<std::is_default_constructible<U>::value>>\n"
+          "    T get(std::size_t i) const {\n"
+          "        T value{};\n";
+    for_each_column("        ", [&](size_t i, llvm::StringRef name) {
+        os << "value." << name << " = column_" << i << "_[i];";
+    });
+    os << "        return value;\n"
+          "    }\n"
+          "    void set(std::size_t i, const T& value) {\n";
+    for_each_column("        ", [&](size_t i, llvm::StringRef name) {
+        os << "column_" << i << "_[i] = value." << name << ';';
+    });
+    os << "    }\n"
+          "    template <typename U = T, typename = std::enable_if_t<std::is_default_constructible<U>::value>>\n"
+          "    std::vector<T> to_aos() const {\n"
+          "        std::vector<T> values;\n"
+          "        values.reserve(size());\n"
+          "        for (std::size_t i = 0; i < size(); i++) {\n"
+          "            values.push_back(get(i));\n"
+          "        }\n"
+          "        return values;\n"
+          "    }\n\n";
+
+    os << "    // Contiguous column of field I, in declaration order.\n";
+    for_each_column("    ", [&](size_t i, llvm::StringRef name) {
+        os << "soa_span<decltype(T::" << name << ")> column(std::integral_constant<std::size_t, " << i
+           << ">) { return { column_" << i << "_.data(), column_" << i << "_.size() }; }\n"
+           << "    soa_span<const decltype(T::" << name << ")> column(std::integral_constant<std::size_t, " << i
+           << ">) const { return { column_" << i << "_.data(), column_" << i << "_.size() }; }";
+    });
+    os << "    template <std::size_t I> auto column() { return column(std::integral_constant<std::size_t, I>{}); }\n"
+          "    template <std::size_t I> auto column() const {\n"
+          "        return column(std::integral_constant<std::size_t, I>{});\n"
+          "    }\n\n";
+
+    os << "private:\n"
+          "    // Pops the last element of the first |count| columns.\n"
+          "    void pop_columns(std::size_t count) {\n";
+    for_each_column("        ", [&](size_t i, llvm::StringRef) {
+        os << "if (count > " << i << ") {\n"
+           << "            column_" << i << "_.pop_back();\n"
+           << "        }";
+    });
+    os << "    }\n\n";
+    for_each_column("    ", [&](size_t i, llvm::StringRef name) {
+        os << "soa_column<decltype(T::" << name << ")> column_" << i << "_;";
+    });
+    os << "};\n";
+}
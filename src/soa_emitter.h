@@ -0,0 +1,14 @@
+#pragma once
+
+#include <llvm/Support/raw_ostream.h>
+
+#include "reflection_data.h"
+
+// Writers for the structure-of-arrays containers generated with --soa.
+
+// Column and span templates shared by every soa_vector, plus the primary soa_vector template.
+void EmitSoaPreamble(llvm::raw_ostream& os);
+
+// soa_vector<T> keeping one contiguous column per field of |reflection|. Types whose fields cannot be stored and
+// assigned one by one (bit-fields, references, arrays, const members) and types without fields get none.
+void EmitSoaVector(llvm::raw_ostream& os, const ReflectionData& reflection);
@@ -0,0 +1,77 @@
+#include "stats.h"
+
+#include <llvm/Support/Format.h>
+#include <llvm/Support/Path.h>
+
+static void PrintSeconds(llvm::raw_ostream& os, double seconds) {
+    os << llvm::format("%10.3f", seconds);
+}
+
+void PrintStats(llvm::raw_ostream& os, const RunStats& stats) {
+    // Parse and match times are exclusive here, unlike in SourceStats, so a row adds up to the frontend time.
+    SourceStats total;
+    double total_parse_seconds = 0;
+    double total_match_seconds = 0;
+    os << "=== refl statistics ===\n" << llvm::left_justify("source", 32);
+    for (const char* column :
+         {"total s", "parse s", "match s", "reflect s", "types", "hits", "reflected", "fields", "methods"}) {
+        os << llvm::right_justify(column, 10);
+    }
+    os << '\n';
+    for (const auto& source : stats.sources) {
+        // Matching runs after parsing inside the frontend, and reflecting inside matching.
+        double parse_seconds = source.frontend_seconds - source.match_seconds;
+        double match_seconds = source.match_seconds - source.reflect_seconds;
+        std::string name = llvm::sys::path::filename(source.source).str();
+        if (source.cached) {
+            name += " (cached)";
+        }
+        os << llvm::left_justify(name, 32);
+        PrintSeconds(os, source.total_seconds);
+        PrintSeconds(os, parse_seconds);
+        PrintSeconds(os, match_seconds);
+        PrintSeconds(os, source.reflect_seconds);
+        os << llvm::format("%10llu%10llu%10llu%10llu%10llu\n",
+                           static_cast<unsigned long long>(source.types_inspected),
+                           static_cast<unsigned long long>(source.type_cache_hits),
+                           static_cast<unsigned long long>(source.reflections),
+                           static_cast<unsigned long long>(source.fields),
+                           static_cast<unsigned long long>(source.methods));
+
+        total.total_seconds += source.total_seconds;
+        total_parse_seconds += parse_seconds;
+        total_match_seconds += match_seconds;
+        total.reflect_seconds += source.reflect_seconds;
+        total.types_inspected += source.types_inspected;
+        total.type_cache_hits += source.type_cache_hits;
+        total.reflections += source.reflections;
+        total.fields += source.fields;
+        total.methods += source.methods;
+    }
+    os << llvm::left_justify("all sources", 32);
+    PrintSeconds(os, total.total_seconds);
+    PrintSeconds(os, total_parse_seconds);
+    PrintSeconds(os, total_match_seconds);
+    PrintSeconds(os, total.reflect_seconds);
+    os << llvm::format("%10llu%10llu%10llu%10llu%10llu\n\n",
+                       static_cast<unsigned long long>(total.types_inspected),
+                       static_cast<unsigned long long>(total.type_cache_hits),
+                       static_cast<unsigned long long>(total.reflections),
+                       static_cast<unsigned long long>(total.fields),
+                       static_cast<unsigned long long>(total.methods));
+
+    auto print_phase = [&](llvm::StringRef phase, double seconds) {
+        os << llvm::left_justify(phase, 32) << llvm::format("%10.3f s\n", seconds);
+    };
+    auto print_count = [&](llvm::StringRef what, uint64_t count) {
+        os << llvm::left_justify(what, 32) << llvm::format("%10llu\n", static_cast<unsigned long long>(count));
+    };
+    print_phase("precompile header", stats.pch_seconds);
+    print_phase("process sources", stats.process_seconds);
+    print_phase("merge results", stats.merge_seconds);
+    print_phase("emit output", stats.emit_seconds);
+    print_count("types", stats.types);
+    print_count("reflected types", stats.reflections);
+    print_count("bytes emitted", stats.bytes_emitted);
+    print_count("metadata arena bytes", stats.arena_bytes);
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <llvm/ADT/StringRef.h>
+#include <llvm/Support/TimeProfiler.h>
+#include <llvm/Support/raw_ostream.h>
+#include <string>
+#include <vector>
+
+// What processing one entry of the source list cost. Times are wall clock seconds and counts cover that translation
+// unit alone, before the results of different sources are merged.
+struct SourceStats {
+    std::string source;
+    bool cached = false;          // loaded from --cache-dir, nothing was parsed
+    double total_seconds = 0;     // everything done for the source, cache lookup and store included
+    double frontend_seconds = 0;  // running the clang tool: parsing, matching and reflecting
+    double match_seconds = 0;     // handing the parsed AST to the matcher or the --fast consumer
+    double reflect_seconds = 0;   // reflecting matched specializations, the InspectType calls included
+    uint64_t types_inspected = 0; // distinct types InspectType looked at
+    uint64_t type_cache_hits = 0; // InspectType calls answered by a type the TU had already inspected
+    uint64_t reflections = 0;
+    uint64_t fields = 0;
+    uint64_t methods = 0;
+};
+
+// Phases of the whole run, after and around the per source work.
+struct RunStats {
+    std::vector<SourceStats> sources;
+    double pch_seconds = 0;
+    double process_seconds = 0; // every source, on all -j threads, until the last one finished
+    double merge_seconds = 0;
+    double emit_seconds = 0; // rendering and writing the header(s) and the schema file
+    uint64_t types = 0;      // after merging
+    uint64_t reflections = 0;
+    uint64_t bytes_emitted = 0;
+    uint64_t arena_bytes = 0; // held by the interned reflection metadata
+};
+
+// Adds the wall time of its scope to |seconds|. While a time trace is being recorded the scope also becomes a trace
+// event, nested under whatever Clang or an outer PhaseTimer is recording on the same thread.
+class PhaseTimer {
+public:
+    PhaseTimer(double& seconds, llvm::StringRef name, llvm::StringRef detail = {})
+        : seconds_(seconds)
+        , trace_(name, detail)
+        , start_(std::chrono::steady_clock::now()) {}
+    ~PhaseTimer() {
+        seconds_ += std::chrono::duration<double>(std::chrono::steady_clock::now() - start_).count();
+    }
+
+    PhaseTimer(const PhaseTimer&) = delete;
+    PhaseTimer& operator=(const PhaseTimer&) = delete;
+
+private:
+    double& seconds_;
+    llvm::TimeTraceScope trace_;
+    std::chrono::steady_clock::time_point start_;
+};
+
+// Prints one row per source and a summary of the whole run as an aligned table.
+void PrintStats(llvm::raw_ostream& os, const RunStats& stats);